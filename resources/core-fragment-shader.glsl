@@ -0,0 +1,20 @@
+#version 150
+
+#ifdef TEXTURE_ARRAY
+in vec3 texture_coordinate;
+uniform sampler2DArray mytexture;
+#else
+in vec2 texture_coordinate;
+uniform sampler2D mytexture;
+#endif
+in vec3 projectedPos;
+
+out vec4 fragmentColor;
+
+void main(void)
+{
+    fragmentColor = texture(mytexture, texture_coordinate);
+#ifdef FOG
+    fragmentColor *= (5.0 - projectedPos.z) / 5.0;
+#endif
+}
@@ -0,0 +1,50 @@
+#version 150
+
+// vertex-shader.glsl without the fixed-function state: attribute locations are bound by createGlProgram
+// (see getVertexAttributeNames), matrices come from uniform blocks bound by bindUniformBlocks
+
+in vec3 vertexPosition;
+in vec3 vertexTextureCoords;
+
+#ifdef TEXTURE_ARRAY
+// the third coordinate is the layer
+out vec3 texture_coordinate;
+#else
+out vec2 texture_coordinate;
+#endif
+out vec3 projectedPos;
+
+// FrameUniforms in UniformBuffers.h, once per frame
+layout(std140) uniform FrameUniforms
+{
+    mat4 projectionViewMatrix;
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+};
+
+#ifdef INSTANCED
+in mat4 instanceModelMatrix;
+#else
+// DrawUniforms in UniformBuffers.h, a range of the per-frame buffer for every draw
+layout(std140) uniform DrawUniforms
+{
+    mat4 modelMatrix;
+};
+#endif
+
+void main()
+{
+#ifdef INSTANCED
+    gl_Position = projectionViewMatrix * (instanceModelMatrix * vec4(vertexPosition, 1.0));
+#else
+    gl_Position = projectionViewMatrix * (modelMatrix * vec4(vertexPosition, 1.0));
+#endif
+    
+    projectedPos = gl_Position.xyz;
+    
+#ifdef TEXTURE_ARRAY
+    texture_coordinate = vertexTextureCoords;
+#else
+    texture_coordinate = vertexTextureCoords.xy;
+#endif
+}
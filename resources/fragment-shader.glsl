@@ -1,12 +1,45 @@
+#ifdef SKINNING
+// skinned meshes are not textured yet
+#define COLORED
+#endif
+
+#ifdef TEXTURE_ARRAY
+#extension GL_EXT_texture_array : enable
+
+varying vec3 texture_coordinate;
+uniform sampler2DArray mytexture;
+#else
 varying vec2 texture_coordinate;
 uniform sampler2D mytexture;
+#endif
 varying vec3 projectedPos;
 
+#ifdef WIREFRAME
+// from wireframe-geometry-shader.glsl, one component is zero on every edge
+varying vec3 barycentric;
+
+uniform vec4 wireframeColor = vec4(0.0, 0.0, 0.0, 1.0);
+// in pixels
+uniform float wireframeWidth = 1.0;
+#endif
+
 void main(void)
 {
+#ifdef COLORED
+    gl_FragColor = gl_Color;
+#elif defined(TEXTURE_ARRAY)
+    gl_FragColor = texture2DArray(mytexture, texture_coordinate);
+#else
     gl_FragColor = texture2D(mytexture, texture_coordinate);
+#endif
 #ifdef FOG
     gl_FragColor *= (5.0 - projectedPos.z) / 5.0;
+#endif
+#ifdef WIREFRAME
+    // distance to the closest edge in pixels, the derivatives keep the width constant on screen
+    vec3 pixels = barycentric / max(fwidth(barycentric), vec3(1e-6));
+    float edge = 1.0 - smoothstep(wireframeWidth - 0.5, wireframeWidth + 0.5, min(pixels.x, min(pixels.y, pixels.z)));
+    gl_FragColor = mix(gl_FragColor, wireframeColor, edge * wireframeColor.a);
 #endif
     //gl_FragColor.x = gl_FragColor.x * gl_FragColor.y;
     //gl_FragColor.x = gl_FragColor.y = gl_FragColor.z = 1.0 - projectedPos.z / 10.0;
@@ -0,0 +1,46 @@
+// Post effects over the texture of a render target, one variant per define:
+// DOWNSAMPLE averages 4x4 source texels with four bilinear fetches,
+// GAUSSIAN is one direction of a separable 9 tap Gaussian in five bilinear fetches,
+// COMPOSITE mixes the source with the motion blur history
+
+varying vec2 texture_coordinate;
+uniform sampler2D mytexture;
+
+// of the source texture
+uniform vec2 texelSize;
+
+#ifdef GAUSSIAN
+// (1, 0) or (0, 1)
+uniform vec2 blurDirection;
+#endif
+
+#ifdef COMPOSITE
+uniform sampler2D historyTexture;
+uniform float sceneWeight;
+#endif
+
+void main(void)
+{
+#if defined(DOWNSAMPLE)
+    vec4 offsets = vec4(-1.0, -1.0, 1.0, 1.0) * texelSize.xyxy;
+    
+    gl_FragColor = (texture2D(mytexture, texture_coordinate + offsets.xy) +
+                    texture2D(mytexture, texture_coordinate + offsets.zy) +
+                    texture2D(mytexture, texture_coordinate + offsets.xw) +
+                    texture2D(mytexture, texture_coordinate + offsets.zw)) * 0.25;
+#elif defined(GAUSSIAN)
+    // pairs of taps merged into one fetch between them, weighted by their sum
+    vec2 step1 = blurDirection * texelSize * 1.3846153846;
+    vec2 step2 = blurDirection * texelSize * 3.2307692308;
+    
+    gl_FragColor = texture2D(mytexture, texture_coordinate) * 0.2270270270 +
+                   (texture2D(mytexture, texture_coordinate + step1) +
+                    texture2D(mytexture, texture_coordinate - step1)) * 0.3162162162 +
+                   (texture2D(mytexture, texture_coordinate + step2) +
+                    texture2D(mytexture, texture_coordinate - step2)) * 0.0702702703;
+#elif defined(COMPOSITE)
+    gl_FragColor = mix(texture2D(historyTexture, texture_coordinate), texture2D(mytexture, texture_coordinate), sceneWeight);
+#else
+    gl_FragColor = texture2D(mytexture, texture_coordinate);
+#endif
+}
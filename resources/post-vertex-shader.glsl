@@ -0,0 +1,9 @@
+// Full-screen quads of FullScreenRenderTarget::renderScreenQuad, already in clip space
+
+varying vec2 texture_coordinate;
+
+void main()
+{
+    gl_Position = gl_Vertex;
+    texture_coordinate = gl_MultiTexCoord0.xy;
+}
@@ -0,0 +1,36 @@
+// Plays back a vertex animation texture baked by VertexAnimationTexture::bake
+// texel (frame * vertexCount + vertexIndex) holds the skinned vertex position
+
+attribute float vertexIndex;
+
+// xyz: world space offset, w: time shift
+attribute vec4 instanceData;
+
+uniform sampler2D animationTexture;
+uniform vec2 textureSize;
+uniform float vertexCount;
+uniform float frameCount;
+uniform float frameRate;
+uniform float time;
+
+uniform mat4 modelMatrix;
+uniform mat4 projectionViewMatrix;
+
+vec3 fetchPosition(float frame)
+{
+    float texel = frame * vertexCount + vertexIndex;
+    vec2 coords = vec2(mod(texel, textureSize.x) + 0.5, floor(texel / textureSize.x) + 0.5) / textureSize;
+    return texture2DLod(animationTexture, coords, 0.0).xyz;
+}
+
+void main()
+{
+    float frame = (time + instanceData.w) * frameRate;
+    float currentFrame = mod(floor(frame), frameCount);
+    float nextFrame = mod(currentFrame + 1.0, frameCount);
+    
+    vec3 position = mix(fetchPosition(currentFrame), fetchPosition(nextFrame), fract(frame));
+    
+    gl_Position = projectionViewMatrix * (modelMatrix * vec4(position, 1.0) + vec4(instanceData.xyz, 0.0));
+    gl_FrontColor = gl_Color;
+}
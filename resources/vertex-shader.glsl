@@ -1,13 +1,74 @@
+#ifdef SKINNING
+#extension GL_ARB_uniform_buffer_object : enable
+// skinned meshes are not textured yet
+#define COLORED
+#endif
+
+#ifdef WIREFRAME
+// wireframe-geometry-shader.glsl passes these on under their usual names
+#define texture_coordinate vertexTextureCoordinate
+#define projectedPos vertexProjectedPos
+#endif
+
+#ifdef TEXTURE_ARRAY
+// the third coordinate is the layer
+varying vec3 texture_coordinate;
+#else
 varying vec2 texture_coordinate;
+#endif
 varying vec3 projectedPos;
 
+#ifdef SKINNING
+// must match GPU_SKINNING_MAX_JOINTS
+#define MAX_JOINTS 128
+
+attribute vec4 jointIndices;
+attribute vec4 jointWeights;
+
+layout(std140) uniform JointPalette
+{
+    mat4 jointMatrices[MAX_JOINTS];
+};
+#endif
+
+#ifdef INSTANCED
+// model matrices come from an instance buffer, the modelview matrix is not used
+uniform mat4 projectionViewMatrix;
+attribute mat4 instanceModelMatrix;
+#endif
+
 void main()
 {
+#ifdef SKINNING
+    // weights of unused influences are zero
+    mat4 skinningMatrix =
+        jointMatrices[int(jointIndices.x)] * jointWeights.x +
+        jointMatrices[int(jointIndices.y)] * jointWeights.y +
+        jointMatrices[int(jointIndices.z)] * jointWeights.z +
+        jointMatrices[int(jointIndices.w)] * jointWeights.w;
+    
+    vec4 vertex = skinningMatrix * gl_Vertex;
+#else
+    vec4 vertex = gl_Vertex;
+#endif
+    
+#ifdef COLORED
+    gl_FrontColor = gl_Color;
+#endif
+    
     // Transforming The Vertex
-    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+#ifdef INSTANCED
+    gl_Position = projectionViewMatrix * (instanceModelMatrix * vertex);
+#else
+    gl_Position = gl_ModelViewProjectionMatrix * vertex;
+#endif
 
     projectedPos = gl_Position.xyz;
     
     // Passing The Texture Coordinate Of Texture Unit 0 To The Fragment Shader
+#ifdef TEXTURE_ARRAY
+    texture_coordinate = gl_MultiTexCoord0.xyz;
+#else
     texture_coordinate = vec2(gl_MultiTexCoord0);
-}
\ No newline at end of file
+#endif
+}
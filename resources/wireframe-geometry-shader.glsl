@@ -0,0 +1,43 @@
+// Solid & wireframe in one pass: every triangle is passed on unchanged with barycentric coordinates
+// of its corners, fragment-shader.glsl compiled with WIREFRAME darkens the fragments close to an edge.
+// The #version comes from the prefix, the other stages need it too.
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+#ifdef TEXTURE_ARRAY
+in vec3 vertexTextureCoordinate[];
+out vec3 texture_coordinate;
+#else
+in vec2 vertexTextureCoordinate[];
+out vec2 texture_coordinate;
+#endif
+
+in vec3 vertexProjectedPos[];
+out vec3 projectedPos;
+
+out vec3 barycentric;
+
+#ifdef SKINNING
+#define COLORED
+#endif
+
+void main()
+{
+    for (int i = 0; i < 3; i++)
+    {
+        barycentric = vec3(0.0);
+        barycentric[i] = 1.0;
+        
+        gl_Position = gl_in[i].gl_Position;
+        texture_coordinate = vertexTextureCoordinate[i];
+        projectedPos = vertexProjectedPos[i];
+#ifdef COLORED
+        gl_FrontColor = gl_in[i].gl_FrontColor;
+#endif
+        
+        EmitVertex();
+    }
+    
+    EndPrimitive();
+}
@@ -0,0 +1,288 @@
+#include "BoundingVolumes.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SGE_X86_KERNELS
+#endif
+
+using namespace std;
+using namespace sge;
+
+AxisAlignedBox::AxisAlignedBox():
+    minCorner(vec3(numeric_limits<ftype>::max())), maxCorner(vec3(-numeric_limits<ftype>::max()))
+{
+}
+
+bool AxisAlignedBox::isEmpty() const
+{
+    return minCorner.x > maxCorner.x || minCorner.y > maxCorner.y || minCorner.z > maxCorner.z;
+}
+
+void AxisAlignedBox::add(vec3 point)
+{
+    minCorner = glm::min(minCorner, point);
+    maxCorner = glm::max(maxCorner, point);
+}
+
+void AxisAlignedBox::add(const AxisAlignedBox& box)
+{
+    if (box.isEmpty())
+        return;
+    
+    minCorner = glm::min(minCorner, box.minCorner);
+    maxCorner = glm::max(maxCorner, box.maxCorner);
+}
+
+AxisAlignedBox AxisAlignedBox::transformed(const mat4& transform) const
+{
+    if (isEmpty())
+        return *this;
+    
+    vec3 center = vec3(transform * vec4(getCenter(), 1));
+    vec3 halfExtent = getHalfExtent();
+    vec3 newHalfExtent;
+    
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 3; column++)
+            newHalfExtent[row] += abs(transform[column][row]) * halfExtent[column];
+    
+    return AxisAlignedBox(center - newHalfExtent, center + newHalfExtent);
+}
+
+bool AxisAlignedBox::isOutsideClipVolume(const mat4& projectionViewModelMatrix) const
+{
+    if (isEmpty())
+        return true;
+    
+    // bit per plane: -x, +x, -y, +y, -z, +z
+    int outsideAll = (1 << 6) - 1;
+    
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 position((corner & 1) ? maxCorner.x : minCorner.x,
+                      (corner & 2) ? maxCorner.y : minCorner.y,
+                      (corner & 4) ? maxCorner.z : minCorner.z);
+        
+        vec4 clip = projectionViewModelMatrix * vec4(position, 1);
+        int outside = 0;
+        
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (clip[axis] < -clip.w) outside |= 1 << (axis * 2);
+            if (clip[axis] > clip.w) outside |= 1 << (axis * 2 + 1);
+        }
+        
+        outsideAll &= outside;
+        if (!outsideAll)
+            return false;
+    }
+    
+    return true;
+}
+
+BoundingSphere BoundingSphere::transformed(const mat4& transform) const
+{
+    ftype maxScale = max(glm::length(vec3(transform[0])), max(glm::length(vec3(transform[1])), glm::length(vec3(transform[2]))));
+    return BoundingSphere(vec3(transform * vec4(center, 1)), radius * maxScale);
+}
+
+void BoxArrays::clear()
+{
+    for (vector<float>* values: { &centerX, &centerY, &centerZ, &halfExtentX, &halfExtentY, &halfExtentZ })
+        values->clear();
+}
+
+void BoxArrays::add(const AxisAlignedBox& box)
+{
+    vec3 center = box.getCenter(), halfExtent = box.getHalfExtent();
+    
+    // empty boxes are never visible
+    if (box.isEmpty())
+        halfExtent = vec3(-numeric_limits<float>::max());
+    
+    centerX.push_back((float)center.x);
+    centerY.push_back((float)center.y);
+    centerZ.push_back((float)center.z);
+    halfExtentX.push_back((float)halfExtent.x);
+    halfExtentY.push_back((float)halfExtent.y);
+    halfExtentZ.push_back((float)halfExtent.z);
+}
+
+Frustum::Frustum(const mat4& projectionViewMatrix)
+{
+    const mat4& m = projectionViewMatrix;
+    
+    // rows of the column-major matrix
+    vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    
+    for (int axis = 0; axis < 3; axis++)
+    {
+        planes[axis * 2] = rows[3] + rows[axis];
+        planes[axis * 2 + 1] = rows[3] - rows[axis];
+    }
+    
+    for (vec4& plane: planes)
+        plane /= glm::length(vec3(plane));
+}
+
+bool Frustum::isOutside(const AxisAlignedBox& box) const
+{
+    if (box.isEmpty())
+        return true;
+    
+    vec3 center = box.getCenter(), halfExtent = box.getHalfExtent();
+    
+    for (const vec4& plane: planes)
+    {
+        vec3 normal(plane);
+        if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), halfExtent) < 0)
+            return true;
+    }
+    
+    return false;
+}
+
+bool Frustum::isOutside(const BoundingSphere& sphere) const
+{
+    if (sphere.radius < 0)
+        return true;
+    
+    for (const vec4& plane: planes)
+        if (glm::dot(vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            return true;
+    
+    return false;
+}
+
+typedef void (*FrustumKernel)(const float planes[6][4], const BoxArrays& boxes, uint8_t* visible, int begin, int end);
+
+static void testBoxesScalar(const float planes[6][4], const BoxArrays& boxes, uint8_t* visible, int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        bool outside = false;
+        
+        for (int p = 0; p < 6 && !outside; p++)
+        {
+            const float* plane = planes[p];
+            float distance = plane[0] * boxes.centerX[i] + plane[1] * boxes.centerY[i] + plane[2] * boxes.centerZ[i] + plane[3];
+            float radius = abs(plane[0]) * boxes.halfExtentX[i] + abs(plane[1]) * boxes.halfExtentY[i]
+                           + abs(plane[2]) * boxes.halfExtentZ[i];
+            
+            outside = distance + radius < 0;
+        }
+        
+        visible[i] = outside ? 0 : 1;
+    }
+}
+
+#ifdef SGE_X86_KERNELS
+
+static void testBoxesSse(const float planes[6][4], const BoxArrays& boxes, uint8_t* visible, int begin, int end)
+{
+    int i = begin;
+    
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 centerX = _mm_loadu_ps(&boxes.centerX[i]), centerY = _mm_loadu_ps(&boxes.centerY[i]);
+        __m128 centerZ = _mm_loadu_ps(&boxes.centerZ[i]);
+        __m128 halfX = _mm_loadu_ps(&boxes.halfExtentX[i]), halfY = _mm_loadu_ps(&boxes.halfExtentY[i]);
+        __m128 halfZ = _mm_loadu_ps(&boxes.halfExtentZ[i]);
+        
+        __m128 outside = _mm_setzero_ps();
+        
+        for (int p = 0; p < 6; p++)
+        {
+            const float* plane = planes[p];
+            
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), centerX),
+                                                    _mm_mul_ps(_mm_set1_ps(plane[1]), centerY)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[2]), centerZ), _mm_set1_ps(plane[3])));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(abs(plane[0])), halfX),
+                                                  _mm_mul_ps(_mm_set1_ps(abs(plane[1])), halfY)),
+                                       _mm_mul_ps(_mm_set1_ps(abs(plane[2])), halfZ));
+            
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        
+        int outsideMask = _mm_movemask_ps(outside);
+        for (int j = 0; j < 4; j++)
+            visible[i + j] = (outsideMask >> j) & 1 ? 0 : 1;
+    }
+    
+    testBoxesScalar(planes, boxes, visible, i, end);
+}
+
+__attribute__((target("avx2,fma")))
+static void testBoxesAvx2(const float planes[6][4], const BoxArrays& boxes, uint8_t* visible, int begin, int end)
+{
+    int i = begin;
+    
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 centerX = _mm256_loadu_ps(&boxes.centerX[i]), centerY = _mm256_loadu_ps(&boxes.centerY[i]);
+        __m256 centerZ = _mm256_loadu_ps(&boxes.centerZ[i]);
+        __m256 halfX = _mm256_loadu_ps(&boxes.halfExtentX[i]), halfY = _mm256_loadu_ps(&boxes.halfExtentY[i]);
+        __m256 halfZ = _mm256_loadu_ps(&boxes.halfExtentZ[i]);
+        
+        __m256 outside = _mm256_setzero_ps();
+        
+        for (int p = 0; p < 6; p++)
+        {
+            const float* plane = planes[p];
+            
+            __m256 distance = _mm256_fmadd_ps(_mm256_set1_ps(plane[0]), centerX,
+                              _mm256_fmadd_ps(_mm256_set1_ps(plane[1]), centerY,
+                              _mm256_fmadd_ps(_mm256_set1_ps(plane[2]), centerZ, _mm256_set1_ps(plane[3]))));
+            __m256 reach = _mm256_fmadd_ps(_mm256_set1_ps(abs(plane[0])), halfX,
+                           _mm256_fmadd_ps(_mm256_set1_ps(abs(plane[1])), halfY,
+                           _mm256_fmadd_ps(_mm256_set1_ps(abs(plane[2])), halfZ, distance)));
+            
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(reach, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        
+        int outsideMask = _mm256_movemask_ps(outside);
+        for (int j = 0; j < 8; j++)
+            visible[i + j] = (outsideMask >> j) & 1 ? 0 : 1;
+    }
+    
+    testBoxesScalar(planes, boxes, visible, i, end);
+}
+
+#endif // SGE_X86_KERNELS
+
+static FrustumKernel selectFrustumKernel()
+{
+    switch (getSimdLevel())
+    {
+#ifdef SGE_X86_KERNELS
+        case SimdLevel::AVX2: return testBoxesAvx2;
+        case SimdLevel::SSE: return testBoxesSse;
+#else
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE:
+#endif
+        case SimdLevel::SCALAR: return testBoxesScalar;
+        default: unreachable();
+    }
+}
+
+void sge::testBoxesAgainstFrustum(const Frustum& frustum, const BoxArrays& boxes, vector<uint8_t>& visible)
+{
+    float planes[6][4];
+    for (int p = 0; p < 6; p++)
+        for (int i = 0; i < 4; i++)
+            planes[p][i] = (float)frustum.planes[p][i];
+    
+    visible.resize(boxes.size());
+    
+    static FrustumKernel kernel = selectFrustumKernel();
+    kernel(planes, boxes, visible.data(), 0, boxes.size());
+}
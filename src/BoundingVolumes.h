@@ -0,0 +1,82 @@
+#ifndef SGE_BOUNDING_VOLUMES_H
+#define SGE_BOUNDING_VOLUMES_H
+
+#include "Common.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+class AxisAlignedBox
+{
+public :
+    // an empty box has minCorner > maxCorner
+    vec3 minCorner, maxCorner;
+    
+    AxisAlignedBox();
+    AxisAlignedBox(vec3 minCorner, vec3 maxCorner): minCorner(minCorner), maxCorner(maxCorner) {}
+    
+    bool isEmpty() const;
+    
+    vec3 getCenter() const { return (minCorner + maxCorner) * 0.5; }
+    vec3 getHalfExtent() const { return (maxCorner - minCorner) * 0.5; }
+    
+    void add(vec3 point);
+    void add(const AxisAlignedBox& box);
+    
+    // box of the transformed box, affine transforms only
+    AxisAlignedBox transformed(const mat4& transform) const;
+    
+    // conservative: true only if all corners are outside the same clip-space plane of the matrix
+    bool isOutsideClipVolume(const mat4& projectionViewModelMatrix) const;
+};
+
+class BoundingSphere
+{
+public :
+    // negative for an empty sphere
+    vec3 center;
+    ftype radius = -1;
+    
+    BoundingSphere() {}
+    BoundingSphere(vec3 center, ftype radius): center(center), radius(radius) {}
+    
+    // the radius is scaled by the longest axis of the transform
+    BoundingSphere transformed(const mat4& transform) const;
+};
+
+// boxes as center & half extent arrays, the layout testBoxesAgainstFrustum reads
+class BoxArrays
+{
+public :
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> halfExtentX, halfExtentY, halfExtentZ;
+    
+    void clear();
+    void add(const AxisAlignedBox& box);
+    int size() const { return (int)centerX.size(); }
+};
+
+// planes with normals pointing inside, extracted from a projection * view matrix
+class Frustum
+{
+public :
+    // -x, +x, -y, +y, -z, +z; normalized
+    vec4 planes[6];
+    
+    Frustum() {}
+    explicit Frustum(const mat4& projectionViewMatrix);
+    
+    bool isOutside(const AxisAlignedBox& box) const;
+    bool isOutside(const BoundingSphere& sphere) const;
+};
+
+// visible[i] is 1 unless box i is completely behind one of the planes;
+// 4 or 8 boxes are tested at once, depending on getSimdLevel
+void testBoxesAgainstFrustum(const Frustum& frustum, const BoxArrays& boxes, std::vector<uint8_t>& visible);
+
+}
+
+#endif // SGE_BOUNDING_VOLUMES_H
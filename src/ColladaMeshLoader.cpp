@@ -1,4 +1,6 @@
 #include "ColladaMeshLoader.h"
+#include "StreamingBuffer.h"
+#include "DebugDraw.h"
 
 #include <pugixml.hpp>
 
@@ -10,6 +12,7 @@
 #include <cctype>
 #include <algorithm>
 #include <queue>
+#include <tuple>
 
 using namespace std;
 using namespace sge;
@@ -71,6 +74,7 @@ public :
     
     xml_node currentNode;
     
+    ColladaImportOptions importOptions;
     vector<Mesh> foundMeshes;
 
     ColladaMeshLoader(): nProcessed(0), nRecreated(0) {}
@@ -820,7 +824,7 @@ public :
                 indexOffset += indexBlockSize;
                 
                 mesh.vertices.push_back(current);
-                mesh.vertexWeights.push_back(verticesInput->verticesSource->vertexWeights[positionIndex]);
+                mesh.vertexInfluences.add(verticesInput->verticesSource->vertexWeights[positionIndex]);
             }
             
             //// NOTE: already asserted in parseFromNode
@@ -927,8 +931,6 @@ public :
     }
 };
 
-#include <ctime>
-
 void normalize(mat4& m)
 {
     /*ftype w = 0;
@@ -986,7 +988,7 @@ void Transform::applyTransform(mat4& to) const
         
         case TransformationType::DEBUG_ROTATE:
         {
-            ftype t = (ftype)clock() / (ftype)CLOCKS_PER_SEC;
+            ftype t = (ftype)SDL_GetTicks() / 1000.0;
             to = to * glm::rotate(t * 45.0 / 180.0 * M_PI, vec3(0.0, 1.0, 0.0));
             break;
         }
@@ -1111,6 +1113,9 @@ vector<string> delimiterSplit(string s, char delimiter)
     return result;
 }
 
+// keyframe times converted to the compact form, by the source float array
+typedef map<const vector<ftype>*, shared_ptr<const vector<float>>> SharedKeyTimes;
+
 class ChannelElement : public Element
 {
 public :
@@ -1253,7 +1258,7 @@ public :
         targetElement->attachedChannels.push_back(this);
     }
     
-    void loadChannel(Mesh& mesh, int jointIndex, int transformIndex)
+    void loadChannel(Mesh& mesh, int jointIndex, int transformIndex, SharedKeyTimes& sharedTimes)
     {
         AnimationChannel newChannel;
         newChannel.jointIndex = jointIndex;
@@ -1261,6 +1266,7 @@ public :
         newChannel.subvalueIndex = effectiveIndex;
         
         int n = source->input->generalSource->accessor->count;
+        verify(n > 0, "Animation sampler '%s' has no keyframes.", source->id.c_str());
         
         FloatVectorAccessor timesAccessor;
         timesAccessor.setup(source->input->generalSource->accessor, FloatVectorValueType::FLOAT);
@@ -1268,12 +1274,28 @@ public :
         FloatVectorAccessor outputAccessor;
         outputAccessor.setup(source->output->generalSource->accessor);
         
-        for (int i = 0; i < n; i++)
+        verify(outputAccessor.count == n, "Animation sampler output count (%d) does not match input count (%d).",
+               outputAccessor.count, n);
+        
+        // decoded tracks are only built by AnimationChannel::decode on the first use
+        shared_ptr<const vector<float>>& times = sharedTimes[timesAccessor.floatVector];
+        if (!times)
         {
-            newChannel.times.push_back(timesAccessor.access(i).getValue<ftype>());
-            newChannel.values.push_back(outputAccessor.access(i));
+            shared_ptr<vector<float>> compactTimes(new vector<float>(n));
+            for (int i = 0; i < n; i++)
+                (*compactTimes)[i] = (float)(*timesAccessor.floatVector)[i];
+            
+            times = compactTimes;
         }
         
+        newChannel.rawTimes = times;
+        newChannel.valueType = outputAccessor.resultingType;
+        newChannel.valueStride = outputAccessor.stride;
+        
+        newChannel.rawValues.resize(n * outputAccessor.stride);
+        for (int i = 0; i < (int)newChannel.rawValues.size(); i++)
+            newChannel.rawValues[i] = (float)(*outputAccessor.floatVector)[i];
+        
         mesh.animationChannels.push_back(newChannel);
     }
 };
@@ -1345,14 +1367,14 @@ public :
             child->loadJoints(mesh);
     }
     
-    void loadChannels(Mesh& mesh)
+    void loadChannels(Mesh& mesh, SharedKeyTimes& sharedTimes)
     {
         for (int i = 0; i < (int)transforms.size(); i++)
             for (ChannelElement* channel: transforms[i]->attachedChannels)
-                channel->loadChannel(mesh, currentMeshIndex, i);
+                channel->loadChannel(mesh, currentMeshIndex, i, sharedTimes);
         
         for (NodeElement* child: nodeChildren)
-            child->loadChannels(mesh);
+            child->loadChannels(mesh, sharedTimes);
     }
 };
 
@@ -1500,6 +1522,67 @@ public :
                 weightPair.second /= totalWeight;
         }
     }
+    
+    // applies maxInfluences & weightBits of the options, returns the number of dropped influences
+    int pruneVertexWeights(Vertices& vertices, const ColladaImportOptions& options)
+    {
+        int nDropped = 0;
+        
+        for (auto& influences: vertices.vertexWeights)
+        {
+            stable_sort(influences.begin(), influences.end(),
+                        [] (const pair<int, ftype>& a, const pair<int, ftype>& b) { return a.second > b.second; });
+            
+            if (options.maxInfluences > 0 && (int)influences.size() > options.maxInfluences)
+            {
+                nDropped += (int)influences.size() - options.maxInfluences;
+                influences.resize(options.maxInfluences);
+            }
+            
+            ftype totalWeight = 0;
+            for (auto& weightPair: influences)
+                totalWeight += weightPair.second;
+            
+            for (auto& weightPair: influences)
+                weightPair.second /= totalWeight;
+            
+            if (options.weightBits == 0 || influences.empty())
+                continue;
+            
+            // largest remainder rounding, quantized weights still sum up to exactly one
+            int scale = (1 << options.weightBits) - 1;
+            int nInfluences = (int)influences.size();
+            
+            vector<int> units(nInfluences);
+            vector<int> byRemainder(nInfluences);
+            int unitsLeft = scale;
+            
+            for (int i = 0; i < nInfluences; i++)
+            {
+                units[i] = (int)floor(influences[i].second * scale);
+                unitsLeft -= units[i];
+                byRemainder[i] = i;
+            }
+            
+            sort(byRemainder.begin(), byRemainder.end(), [&] (int a, int b)
+                 { return influences[a].second * scale - units[a] > influences[b].second * scale - units[b]; });
+            
+            for (int i = 0; i < unitsLeft; i++)
+                units[byRemainder[i % nInfluences]]++;
+            
+            for (int i = 0; i < nInfluences; i++)
+                influences[i].second = units[i] / (ftype)scale;
+            
+            // rounded down to nothing
+            while (!influences.empty() && units[influences.size() - 1] == 0)
+            {
+                influences.pop_back();
+                nDropped++;
+            }
+        }
+        
+        return nDropped;
+    }
 };
 
 class Skin : public Element
@@ -1551,6 +1634,42 @@ public :
     }
 };
 
+// largest distance between vertices skinned with the imported & with the pruned weights,
+// over poses sampled across the whole animation; changes the mesh pose
+static ftype measureSkinningError(Mesh& mesh, const vector<vec3>& positions,
+                                  const vector<vector<pair<int, ftype>>>& importedWeights,
+                                  const vector<vector<pair<int, ftype>>>& prunedWeights)
+{
+    const int N_POSE_SAMPLES = 16;
+    
+    ftype startTime = mesh.getAnimationStartTime();
+    ftype endTime = mesh.getAnimationEndTime();
+    
+    auto skin = [&mesh] (vec3 position, const vector<pair<int, ftype>>& influences)
+    {
+        vec3 result;
+        for (auto& weightPair: influences)
+            result += vec3(mesh.joints[weightPair.first].transformationMatrix * vec4(position, 1)) * weightPair.second;
+        
+        return result;
+    };
+    
+    ftype maxError = 0;
+    
+    for (int sample = 0; sample < N_POSE_SAMPLES; sample++)
+    {
+        mesh.sampleCompactPose(startTime + (endTime - startTime) * sample / (N_POSE_SAMPLES - 1));
+        
+        for (int i = 0; i < (int)positions.size(); i++)
+        {
+            vec3 position = vec3(mesh.bindShapeMatrix * vec4(positions[i], 1));
+            maxError = max(maxError, glm::length(skin(position, importedWeights[i]) - skin(position, prunedWeights[i])));
+        }
+    }
+    
+    return maxError;
+}
+
 class InstanceController : public Element
 {
 public :
@@ -1587,11 +1706,63 @@ public :
             mesh.armatureTransformStack.transforms.push_back(e->transform);
         
         skeleton->loadJoints(mesh);
-        skeleton->loadChannels(mesh);
+        
+        SharedKeyTimes sharedTimes;
+        skeleton->loadChannels(mesh, sharedTimes);
+        
+        size_t compactBytes = 0;
+        for (auto& it: sharedTimes)
+            compactBytes += it.second->size() * sizeof(float);
+        for (const AnimationChannel& channel: mesh.animationChannels)
+            compactBytes += channel.rawValues.size() * sizeof(float);
+        
+        printf("%d animation channels loaded, %.1f Kb of compact keyframes\n",
+               (int)mesh.animationChannels.size(), (ftype)compactBytes / 1024.0);
         toInstance->skin->joints->loadInverseBindMatrices(mesh, skeleton, loader);
-        toInstance->skin->vertexWeights->loadVertexWeights(*toInstance->skin->baseGeometry->meshElement->vertices, skeleton, loader);
         
+        Vertices& vertices = *toInstance->skin->baseGeometry->meshElement->vertices;
+        VertexWeights& vertexWeights = *toInstance->skin->vertexWeights;
+        
+        vertexWeights.loadVertexWeights(vertices, skeleton, loader);
+        
+        const ColladaImportOptions& options = loader.importOptions;
+        
+        vector<vector<pair<int, ftype>>> importedWeights;
+        if (options.measureSkinningError)
+            importedWeights = vertices.vertexWeights;
+        
+        size_t maxImported = 0;
+        for (auto& influences: vertices.vertexWeights)
+            maxImported = max(maxImported, influences.size());
+        
+        int nDropped = vertexWeights.pruneVertexWeights(vertices, options);
+        
+        mesh.vertexInfluences.reset(options.weightBits);
         toInstance->loadMesh(mesh);
+        
+        printf("Skin influences: up to %d per vertex imported, %d dropped (max %d, %d-bit weights), %.1f Kb\n",
+               (int)maxImported, nDropped, options.maxInfluences, options.weightBits,
+               (ftype)mesh.vertexInfluences.getSizeBytes() / 1024.0);
+        
+        if (options.measureSkinningError)
+        {
+            FloatVectorAccessor positionsAccessor;
+            positionsAccessor.setup(vertices.position->generalSource->accessor, FloatVectorValueType::FLOAT_3);
+            
+            verify(positionsAccessor.count == (int)vertices.vertexWeights.size(),
+                   "Skin has weights for %d vertices, the mesh has %d.",
+                   (int)vertices.vertexWeights.size(), positionsAccessor.count);
+            
+            vector<vec3> positions(vertices.vertexWeights.size());
+            for (int i = 0; i < (int)positions.size(); i++)
+                positions[i] = positionsAccessor.access(i).getValue<vec3>();
+            
+            printf("Skin influences: max positional error %g\n",
+                   measureSkinningError(mesh, positions, importedWeights, vertices.vertexWeights));
+        }
+        
+        mesh.computeBounds();
+        mesh.generateLods(options.lodLevels);
     }
 };
 
@@ -1705,44 +1876,47 @@ void ColladaMeshLoader::loadDocument(string fileName)
     controllerRecreated->loadMesh(foundMeshes.back(), *this);
 }
 
-Mesh sge::loadColladaMeshNew(string fileName)
+Mesh sge::loadColladaMeshNew(string fileName, const ColladaImportOptions& options)
 {
+    verify(options.maxInfluences >= 0, "Maximum number of influences per vertex can't be negative.");
+    verify(options.weightBits == 0 || options.weightBits == 8 || options.weightBits == 16,
+           "Skin weights can be quantized to 8 or 16 bits only, %d requested.", options.weightBits);
+    verify(options.lodLevels >= 0, "Number of generated levels of detail can't be negative.");
+    
     ColladaMeshLoader loader;
+    loader.importOptions = options;
     loader.loadDocument(fileName);
     
     verify(loader.foundMeshes.size() == 1, "Should've loaded a single mesh.");
     return loader.foundMeshes[0];
 }
 
-void Mesh::slowRender()
+void Mesh::slowRender(GLuint wireframeProgram)
 {   
-    applyAnimation();
+    // the pose sampled by the previous frame was skinned in background, see the end of this function
+    finishSkinning();
+    
+    if (!skinned)
+    {
+        applyAnimation();
+        updateJointMatrices();
+    }
+    
+    // does nothing unless the pose was changed in between, e.g. by updatePose of a culled mesh
+    applySkinning();
     
     glDisable(GL_TEXTURE_2D);
     glEnable(GL_COLOR_MATERIAL);
     
-    GLint wasMode[2];
-    glGetIntegerv(GL_POLYGON_MODE, wasMode);
-    
+    glUseProgram(wireframeProgram);
     glColor3d(1, 1, 1);
-    glPolygonOffset(0, 0);
-    slowRenderPass(wasMode[0] == GL_LINE);
-    
-    glLineWidth(2);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    glColor3d(0, 0, 0);
-    glPolygonOffset(-2, -2);
-    slowRenderPass(wasMode[0] == GL_LINE);
-    glLineWidth(1);
-    
-    glPolygonMode(GL_FRONT, wasMode[0]);
-    glPolygonMode(GL_BACK, wasMode[1]);
+    slowRenderPass(false);
+    glUseProgram(0);
     
-    
-    if (!skinned)
+    if (applyAnimation())
     {
-        //skinned = true;
-        applySkinning();
+        updateJointMatrices();
+        beginSkinning();
     }
 }
 
@@ -1763,19 +1937,12 @@ void Mesh::slowRenderPass(bool /*skeletonOnly*/)
         //armatureTransformStack.transforms.push_back(Transform { TransformationType::DEBUG_ROTATE });
     }
     
-    static bool premultiplied = false;
-    
-    if (!premultiplied)
-    {
-        premultiplied = true;
-        for (auto& it: vertices)
-            it.position = vec3(bindShapeMatrix * vec4(it.position, 1));
-    }
+    applyBindShapeMatrix();
     
     //if (!skeletonOnly)
     //if (false)
         for (Polylist& p: polylists)
-            p.slowRender(vertices);
+            p.slowRender(skinnedPositions);
 }
 
 void interpolate(const FloatVectorValue& a, const FloatVectorValue& b, FloatVectorValue& result, ftype t)
@@ -1789,8 +1956,42 @@ void interpolate(const FloatVectorValue& a, const FloatVectorValue& b, FloatVect
         result.subvalues[i] = a.subvalues[i] * (1 - t) + b.subvalues[i] * t;
 }
 
+void AnimationChannel::decode()
+{
+    int nKeys = (int)rawTimes->size();
+    
+    times.assign(rawTimes->begin(), rawTimes->end());
+    values.resize(nKeys);
+    
+    for (int i = 0; i < nKeys; i++)
+    {
+        values[i].type = valueType;
+        values[i].subvalues.assign(rawValues.begin() + i * valueStride, rawValues.begin() + (i + 1) * valueStride);
+    }
+}
+
+void AnimationChannel::evict()
+{
+    // swap to really release the memory
+    vector<ftype>().swap(times);
+    vector<FloatVectorValue>().swap(values);
+}
+
+size_t AnimationChannel::getDecodedSizeBytes() const
+{
+    if (!isDecoded())
+        return 0;
+    
+    return times.size() * sizeof(ftype) + values.size() * (sizeof(FloatVectorValue) + valueStride * sizeof(ftype));
+}
+
 void AnimationChannel::applyValue(Mesh& to, sge::ftype t)
 {
+    if (!isDecoded())
+        decode();
+    
+    lastUsedTick = to.animationTick;
+    
     //t = 0.0;
     /*if (subvalueIndex == -1)
     {
@@ -1829,12 +2030,88 @@ void AnimationChannel::applyValue(Mesh& to, sge::ftype t)
     assert(found);
 }
 
-void Mesh::applyAnimation()
+void AnimationChannel::applyRawValue(Mesh& to, ftype t) const
+{
+    const vector<float>& keyTimes = *rawTimes;
+    int nKeys = (int)keyTimes.size();
+    ftype span = keyTimes.back() - keyTimes.front();
+    
+    if (span > 0)
+    {
+        while (t > keyTimes.back()) t -= span;
+        while (t < keyTimes.front()) t += span;
+    }
+    
+    int key = 0;
+    while (key + 2 < nKeys && keyTimes[key + 1] < t - FTYPE_WEAK_EPS)
+        key++;
+    
+    int nextKey = min(key + 1, nKeys - 1);
+    ftype keySpan = keyTimes[nextKey] - keyTimes[key];
+    ftype tInterp = keySpan > 0 ? glm::clamp((t - keyTimes[key]) / keySpan, 0.0, 1.0) : 0;
+    
+    const float* a = &rawValues[key * valueStride];
+    const float* b = &rawValues[nextKey * valueStride];
+    FloatVectorValue& value = to.joints[jointIndex].transformStack.transforms[transformIndex].value;
+    
+    if (subvalueIndex != -1)
+        value.subvalues[subvalueIndex] = a[0] * (1 - tInterp) + b[0] * tInterp;
+    else
+    {
+        SDL_assert((int)value.subvalues.size() == valueStride);
+        
+        for (int i = 0; i < valueStride; i++)
+            value.subvalues[i] = a[i] * (1 - tInterp) + b[i] * tInterp;
+    }
+}
+
+void Mesh::applyBindShapeMatrix()
+{
+    if (bindShapeApplied)
+        return;
+    
+    bindShapeApplied = true;
+    for (auto& it: vertices)
+        it.position = vec3(bindShapeMatrix * vec4(it.position, 1));
+}
+
+// wall time, clock() counts the CPU time of all threads & runs faster while the worker pool is busy
+static ftype getAnimationClockTime()
+{
+    return (ftype)SDL_GetPerformanceCounter() / (ftype)SDL_GetPerformanceFrequency();
+}
+
+void Mesh::setAnimationPaused(bool paused)
+{
+    if (paused == animationPaused)
+        return;
+    
+    if (paused)
+        pausedAnimationTime = getAnimationClockTime() - animationClockOffset;
+    else
+        animationClockOffset = getAnimationClockTime() - pausedAnimationTime;
+    
+    animationPaused = paused;
+}
+
+bool Mesh::applyAnimation()
 {
-    ftype t = (ftype)clock() / (ftype)CLOCKS_PER_SEC;
+    ftype t = animationPaused ? pausedAnimationTime : getAnimationClockTime() - animationClockOffset;
     //t *= 0.01;
     //t = 0;
     
+    return applyAnimation(t);
+}
+
+bool Mesh::applyAnimation(ftype t)
+{
+    if (hasSampledTime && weakEq(t, sampledTime))
+        return false;
+    
+    hasSampledTime = true;
+    sampledTime = t;
+    animationTick++;
+    
     //for (AnimationChannel& channel: animationChannels)
     for (int i = 0; i < min((int)animationChannels.size(), 9 * 5 * 100); i++)
     {
@@ -1842,86 +2119,466 @@ void Mesh::applyAnimation()
         channel.applyValue(*this, t);
     }
     //exit(0);
+    
+    enforceAnimationMemoryBudget();
+    return true;
 }
 
-void Mesh::applySkinning()
+void Mesh::enforceAnimationMemoryBudget()
+{
+    size_t decodedBytes = 0;
+    vector<AnimationChannel*> evictable;
+    
+    for (AnimationChannel& channel: animationChannels)
+    {
+        if (!channel.isDecoded())
+            continue;
+        
+        decodedBytes += channel.getDecodedSizeBytes();
+        
+        if (channel.lastUsedTick != animationTick)
+            evictable.push_back(&channel);
+    }
+    
+    if (decodedBytes <= animationMemoryBudget)
+        return;
+    
+    sort(evictable.begin(), evictable.end(),
+         [] (const AnimationChannel* a, const AnimationChannel* b) { return a->lastUsedTick < b->lastUsedTick; });
+    
+    for (AnimationChannel* channel: evictable)
+    {
+        if (decodedBytes <= animationMemoryBudget)
+            break;
+        
+        decodedBytes -= channel->getDecodedSizeBytes();
+        channel->evict();
+    }
+}
+
+void Mesh::updateJointMatrices()
+{
+    mat4 root;
+    armatureTransformStack.applyTransforms(root);
+    
+    joints[0].updateTransformationMatrix(*this, root);
+}
+
+void Mesh::updatePose()
+{
+    if (applyAnimation())
+        updateJointMatrices();
+}
+
+void Mesh::sampleCompactPose(ftype t)
 {
+    for (const AnimationChannel& channel: animationChannels)
+        channel.applyRawValue(*this, t);
+    
+    updateJointMatrices();
+    hasSampledTime = false;
+}
+
+void Mesh::computeBounds()
+{
+    jointBindBoxes.assign(joints.size(), AxisAlignedBox());
+    
+    for (int i = 0; i < (int)vertices.size(); i++)
+    {
+        vec3 position = bindShapeApplied ? vertices[i].position : vec3(bindShapeMatrix * vec4(vertices[i].position, 1));
+        
+        for (int slot = 0; slot < MAX_PACKED_INFLUENCES; slot++)
+            if (vertexInfluences.getWeight(i, slot) > 0)
+                jointBindBoxes[vertexInfluences.getJoint(i, slot)].add(position);
+    }
+    
+    vector<ftype> keyTimes;
+    for (const AnimationChannel& channel: animationChannels)
+        keyTimes.insert(keyTimes.end(), channel.rawTimes->begin(), channel.rawTimes->end());
+    
+    sort(keyTimes.begin(), keyTimes.end());
+    keyTimes.erase(unique(keyTimes.begin(), keyTimes.end()), keyTimes.end());
+    
+    if (keyTimes.empty())
+        keyTimes.push_back(0);
+    
+    // interpolated poses between keys are sampled too, slerped rotations of long limbs leave the key poses
+    vector<ftype> sampleTimes;
+    for (int i = 0; i + 1 < (int)keyTimes.size(); i++)
+        for (int s = 0; s < ANIMATION_BOUNDS_SUBSAMPLES; s++)
+            sampleTimes.push_back(keyTimes[i] + (keyTimes[i + 1] - keyTimes[i]) * s / ANIMATION_BOUNDS_SUBSAMPLES);
+    
+    sampleTimes.push_back(keyTimes.back());
+    
+    animationBounds = AxisAlignedBox();
+    vector<AxisAlignedBox> previousBoxes;
+    
+    // sampled from the compact keyframes, the import leaves every track undecoded
+    for (ftype t: sampleTimes)
+    {
+        sampleCompactPose(t);
+        
+        vector<AxisAlignedBox> boxes(joints.size());
+        
+        for (int i = 0; i < (int)jointBindBoxes.size(); i++)
+        {
+            if (jointBindBoxes[i].isEmpty())
+                continue;
+            
+            boxes[i] = jointBindBoxes[i].transformed(joints[i].transformationMatrix);
+            animationBounds.add(boxes[i]);
+            
+            if (previousBoxes.empty())
+                continue;
+            
+            // a point turning by less than half a turn between two samples stays within half
+            // of the distance it moves from the segment joining its sampled positions
+            const AxisAlignedBox& previous = previousBoxes[i];
+            ftype margin = max(glm::length(boxes[i].minCorner - previous.minCorner),
+                               glm::length(boxes[i].maxCorner - previous.maxCorner)) * 0.5;
+            
+            AxisAlignedBox swept = boxes[i];
+            swept.add(previous);
+            
+            animationBounds.add(swept.minCorner - vec3(margin, margin, margin));
+            animationBounds.add(swept.maxCorner + vec3(margin, margin, margin));
+        }
+        
+        previousBoxes.swap(boxes);
+    }
+}
+
+void Mesh::generateLods(int nLevels)
+{
+    lods.clear();
+    
+    // every face has its own vertices, the simplifier needs them welded by position
+    vector<vec3> positions;
+    vector<int> weldedSource, welded(vertices.size());
+    map<tuple<ftype, ftype, ftype>, int> weldedByPosition;
+    AxisAlignedBox bounds;
     
-    int nWeightings = 0;
     for (int i = 0; i < (int)vertices.size(); i++)
     {
-        vec4 v = vec4(vertices[i].position, 1);
-        vec3& result = vertices[i].skinnedPosition;
+        vec3 position = vertices[i].position;
+        
+        auto key = make_tuple(position.x, position.y, position.z);
+        auto inserted = weldedByPosition.insert(make_pair(key, (int)positions.size()));
         
-        result = vec3();
-        for (int j = 0; j < (int)vertexWeights[i].size(); j++)
+        if (inserted.second)
         {
-            int jointIndex = vertexWeights[i][j].first;
-            ftype weight = vertexWeights[i][j].second;
-            nWeightings++;
-            result += vec3(joints[jointIndex].transformationMatrix /* joints[jointIndex].inverseBindMatrix*/ /* bindShapeMatrix*/ * v * weight);
+            positions.push_back(position);
+            weldedSource.push_back(i);
+            bounds.add(position);
         }
+        
+        welded[i] = inserted.first->second;
     }
     
-    //printf("%d vertices %d weightings, %g avg\n", (int)vertices.size(), nWeightings, nWeightings / (ftype)vertices.size());
+    // original & welded indices of every triangle
+    vector<int> originalIndices, indices, triangleOwner;
+    // original vertices at every welded position, by polylist
+    map<pair<int, int>, int> originalByWelded;
+    
+    for (int i = 0; i < (int)polylists.size(); i++)
+    {
+        for (int index: polylists[i].indices)
+        {
+            originalIndices.push_back(index);
+            indices.push_back(welded[index]);
+            originalByWelded.insert(make_pair(make_pair(welded[index], i), index));
+        }
+        
+        triangleOwner.resize(indices.size() / 3, i);
+    }
+    
+    if (indices.empty())
+        return;
+    
+    ftype maxError = glm::length(bounds.getHalfExtent()) * LOD_MAX_RELATIVE_ERROR;
+    
+    for (const SimplifiedTriangles& simplified: generateLodLevels(positions, indices, nLevels, maxError))
+    {
+        MeshLodLevel lod;
+        lod.polylistIndices.resize(polylists.size());
+        
+        for (int t = 0; t < simplified.getTriangleCount(); t++)
+        {
+            int source = simplified.sourceTriangles[t];
+            int owner = triangleOwner[source];
+            vector<int>& polylistIndices = lod.polylistIndices[owner];
+            
+            for (int corner = 0; corner < 3; corner++)
+            {
+                int weldedVertex = simplified.indices[t * 3 + corner];
+                
+                // vertices at the same position may differ in anything else, e.g. across a seam, so a corner
+                // kept from the source triangle takes its vertex; a corner collapsed into from elsewhere
+                // takes a vertex of the same polylist at that position
+                auto sameOwner = originalByWelded.find(make_pair(weldedVertex, owner));
+                int vertex = sameOwner != originalByWelded.end() ? sameOwner->second : weldedSource[weldedVertex];
+                
+                for (int sourceCorner = 0; sourceCorner < 3; sourceCorner++)
+                    if (indices[source * 3 + sourceCorner] == weldedVertex)
+                        vertex = originalIndices[source * 3 + sourceCorner];
+                
+                polylistIndices.push_back(vertex);
+            }
+        }
+        
+        printf("LOD %d: %d of %d triangles, error %g\n", (int)lods.size() + 1, simplified.getTriangleCount(),
+               (int)indices.size() / 3, simplified.error);
+        
+        lods.push_back(lod);
+    }
 }
 
-void Polylist::slowRender(vector<Vertex>& vertices)
+vector<int> Mesh::getLodIndices(int level) const
 {
-    //printf("slow render %d vertices %d indices\n", vertices.size(), indices.size());
+    SDL_assert(level >= 0 && level < getLodCount());
     
-    glBindTexture(GL_TEXTURE_2D, material.diffuseTexture.loadedId);
+    vector<int> indices;
     
-    glBegin(GL_TRIANGLES);
-    for (size_t i = 0; i < indices.size(); i++)
+    for (int i = 0; i < (int)polylists.size(); i++)
     {
-        vertices[indices[i]].slowRender();
+        const vector<int>& polylistIndices = level == 0 ? polylists[i].indices : lods[level - 1].polylistIndices[i];
+        indices.insert(indices.end(), polylistIndices.begin(), polylistIndices.end());
     }
-    glEnd();
+    
+    return indices;
 }
 
-void Vertex::slowRender()
+AxisAlignedBox Mesh::getPoseBounds() const
 {
-    glVertex3d(skinnedPosition.x, skinnedPosition.y, skinnedPosition.z);
+    AxisAlignedBox bounds;
+    
+    for (int i = 0; i < (int)jointBindBoxes.size(); i++)
+        bounds.add(jointBindBoxes[i].transformed(joints[i].transformationMatrix));
+    
+    return bounds;
 }
 
-void dumpRenderCube(mat4 transform)
+ftype Mesh::getAnimationStartTime() const
 {
-    std::vector<vec3> vertices =
-        { { -1, -1, -1 }, { -1, -1, +1 },
-          { -1, +1, -1 }, { -1, +1, +1 }, 
-          { +1, -1, -1 }, { +1, -1, +1 },
-          { +1, +1, -1 }, { +1, +1, +1 } };
-          
-    for (vec3& v: vertices)
-        v = vec3(transform * vec4(v, 1));
+    ftype start = 0;
     
-    vector<int> indices;
+    for (int i = 0; i < (int)animationChannels.size(); i++)
+        if (i == 0 || animationChannels[i].getStartTime() < start)
+            start = animationChannels[i].getStartTime();
+    
+    return start;
+}
+
+ftype Mesh::getAnimationEndTime() const
+{
+    ftype end = 0;
     
-#define quad(a, b, c, d) \
-    { \
-        indices.push_back(a); indices.push_back(b); indices.push_back(c); \
-        indices.push_back(a); indices.push_back(c); indices.push_back(d); \
+    for (int i = 0; i < (int)animationChannels.size(); i++)
+        if (i == 0 || animationChannels[i].getEndTime() > end)
+            end = animationChannels[i].getEndTime();
+    
+    return end;
+}
+
+void Mesh::packSkin()
+{
+    applyBindShapeMatrix();
+    
+    int n = (int)vertices.size();
+    verify(joints.size() <= 65536, "Packed skinning supports up to 65536 joints, mesh has %d.", (int)joints.size());
+    
+    packedSkin.bindPositions.resize(n);
+    packedSkin.jointIndices.resize(n * MAX_PACKED_INFLUENCES);
+    packedSkin.jointWeights.resize(n * MAX_PACKED_INFLUENCES);
+    
+    for (int i = 0; i < n; i++)
+    {
+        packedSkin.bindPositions.x[i] = (float)vertices[i].position.x;
+        packedSkin.bindPositions.y[i] = (float)vertices[i].position.y;
+        packedSkin.bindPositions.z[i] = (float)vertices[i].position.z;
+        
+        int jointIndices[MAX_PACKED_INFLUENCES];
+        ftype weights[MAX_PACKED_INFLUENCES];
+        getPackedInfluences(i, jointIndices, weights);
+        
+        for (int j = 0; j < MAX_PACKED_INFLUENCES; j++)
+        {
+            packedSkin.jointIndices[i * MAX_PACKED_INFLUENCES + j] = (uint16_t)jointIndices[j];
+            packedSkin.jointWeights[i * MAX_PACKED_INFLUENCES + j] = (float)weights[j];
+        }
+    }
+    
+    skinnedPositions.resize(n);
+    pendingSkinnedPositions.resize(n);
+    skinned = false;
+}
+
+// 2048 vertices of PackedSkin input & output take ~100 Kb, a range stays in L2 of the core skinning it
+const int SKINNING_RANGE_VERTICES = 2048;
+
+void Mesh::beginSkinning()
+{
+    finishSkinning();
+    
+    if (packedSkin.size() != (int)vertices.size())
+        packSkin();
+    
+    nextJointPalette.resize(joints.size() * PALETTE_MATRIX_FLOATS);
+    
+    for (int i = 0; i < (int)joints.size(); i++)
+    {
+        const mat4& m = joints[i].transformationMatrix;
+        
+        for (int column = 0; column < 4; column++)
+            for (int row = 0; row < 4; row++)
+                nextJointPalette[i * PALETTE_MATRIX_FLOATS + column * 4 + row] = (float)m[column][row];
+    }
+    
+    // same pose as on screen, skinnedPositions are reused
+    if (skinned && nextJointPalette == jointPalette)
+        return;
+    
+    swap(jointPalette, nextJointPalette);
+    skinningPending = true;
+    
+    // palette & skin are not touched until finishSkinning, tasks can keep pointers to them
+    const PackedSkin* skin = &packedSkin;
+    const float* palette = jointPalette.data();
+    PositionArrays* output = &pendingSkinnedPositions;
+    
+    WorkerPool::instance().submitRanges(skinningTasks, 0, packedSkin.size(), SKINNING_RANGE_VERTICES,
+                                        [skin, palette, output] (int begin, int end)
+                                        {
+                                            skinPositions(*skin, palette, *output, begin, end);
+                                        });
+}
+
+void Mesh::finishSkinning()
+{
+    if (!skinningPending)
+        return;
+    
+    skinningTasks.wait();
+    swap(skinnedPositions, pendingSkinnedPositions);
+    
+    skinningPending = false;
+    skinned = true;
+}
+
+void Mesh::applySkinning()
+{
+    beginSkinning();
+    finishSkinning();
+}
+
+void VertexInfluences::reset(int newWeightBits)
+{
+    SDL_assert(newWeightBits == 0 || newWeightBits == 8 || newWeightBits == 16);
+    weightBits = newWeightBits;
+    
+    jointIndices.clear();
+    weights8.clear();
+    weights16.clear();
+    floatWeights.clear();
+}
+
+void VertexInfluences::add(const vector<pair<int, ftype>>& influences)
+{
+    vector<pair<int, ftype>> sorted = influences;
+    
+    int nKept = min((int)sorted.size(), MAX_PACKED_INFLUENCES);
+    partial_sort(sorted.begin(), sorted.begin() + nKept, sorted.end(),
+                 [] (const pair<int, ftype>& a, const pair<int, ftype>& b) { return a.second > b.second; });
+    
+    ftype totalWeight = 0;
+    for (int i = 0; i < nKept; i++)
+        totalWeight += sorted[i].second;
+    
+    ftype scale = weightBits ? (ftype)((1 << weightBits) - 1) : 1;
+    
+    for (int i = 0; i < MAX_PACKED_INFLUENCES; i++)
+    {
+        int joint = i < nKept ? sorted[i].first : 0;
+        ftype weight = i < nKept && totalWeight > FTYPE_WEAK_EPS ? sorted[i].second / totalWeight : 0;
+        
+        verify(joint >= 0 && joint < 65536, "Skin influences support up to 65536 joints, joint %d found.", joint);
+        jointIndices.push_back((uint16_t)joint);
+        
+        // weights quantized at import are multiples of 1 / scale already, rounding keeps them exact
+        if (weightBits == 8)
+            weights8.push_back((uint8_t)floor(weight * scale + 0.5));
+        else if (weightBits == 16)
+            weights16.push_back((uint16_t)floor(weight * scale + 0.5));
+        else
+            floatWeights.push_back((float)weight);
     }
+}
+
+ftype VertexInfluences::getWeight(int vertex, int slot) const
+{
+    int i = vertex * MAX_PACKED_INFLUENCES + slot;
     
-    quad(0, 1, 3, 2);
-    quad(4, 5, 7, 6);
+    if (weightBits == 8)
+        return weights8[i] / 255.0;
+    if (weightBits == 16)
+        return weights16[i] / 65535.0;
     
-    quad(0, 1, 5, 4);
-    quad(2, 3, 7, 6);
+    return floatWeights[i];
+}
+
+size_t VertexInfluences::getSizeBytes() const
+{
+    return jointIndices.size() * sizeof(uint16_t) + weights8.size() * sizeof(uint8_t) +
+           weights16.size() * sizeof(uint16_t) + floatWeights.size() * sizeof(float);
+}
+
+void Mesh::getPackedInfluences(int vertex, int jointIndices[MAX_PACKED_INFLUENCES], ftype weights[MAX_PACKED_INFLUENCES]) const
+{
+    ftype totalWeight = 0;
     
-    quad(0, 2, 6, 4);
-    quad(1, 3, 7, 5);
+    for (int i = 0; i < MAX_PACKED_INFLUENCES; i++)
+    {
+        jointIndices[i] = vertexInfluences.getJoint(vertex, i);
+        weights[i] = vertexInfluences.getWeight(vertex, i);
+        totalWeight += weights[i];
+    }
     
-#undef quad
+    if (totalWeight > FTYPE_WEAK_EPS)
+        for (int i = 0; i < MAX_PACKED_INFLUENCES; i++)
+            weights[i] /= totalWeight;
+}
+
+void Polylist::slowRender(const PositionArrays& positions)
+{
+    //printf("slow render %d vertices %d indices\n", vertices.size(), indices.size());
     
-    glBegin(GL_TRIANGLES);
-    for (int i = 0; i < indices.size(); i++)
+    glBindTexture(GL_TEXTURE_2D, material.diffuseTexture.loadedId);
+    
+    if (indices.empty())
+        return;
+    
+    // skinned positions change every frame, they are written right into the streaming buffer
+    StreamingBuffer& stream = StreamingBuffer::instance();
+    StreamingAllocation allocation = stream.allocate(indices.size() * 3 * sizeof(float));
+    
+    float* data = (float*)allocation.data;
+    for (int index: indices)
     {
-        vec3 v = vertices[indices[i]];
-        glVertex3d(v.x, v.y, v.z);
+        *data++ = positions.x[index];
+        *data++ = positions.y[index];
+        *data++ = positions.z[index];
     }
-    glEnd();
+    
+    stream.flush();
+    
+    glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*)allocation.offset);
+    
+    glDrawArrays(GL_TRIANGLES, 0, (GLsizei)indices.size());
+    
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void SkeletonJoint::slowRender(Mesh& mesh, mat4 parentTransform, bool renderSkeleton)
@@ -1938,12 +2595,17 @@ void SkeletonJoint::slowRender(Mesh& mesh, mat4 parentTransform, bool renderSkel
     mat4 scaleMatrix = mat4();
     scaleMatrix = glm::scale(scaleMatrix, vec3(0.1, 0.1, 0.1));
     
+    vec3 parentOrigin = vec3(parentTransform * vec4(0, 0, 0, 1));
+    
     if (renderSkeleton)
-        dumpRenderCube(parentTransform * scaleMatrix);
+        DebugDraw::instance().addSolidBox(parentTransform * scaleMatrix, vec4(0.9, 0.9, 0.9, 1));
 
     transformStack.applyTransforms(parentTransform);
     transformationMatrix = parentTransform * inverseBindMatrix;
     
+    if (renderSkeleton)
+        DebugDraw::instance().addLine(parentOrigin, vec3(parentTransform * vec4(0, 0, 0, 1)), vec4(1, 0.8, 0, 1));
+    
     /*glm::vec4 zero(0, 0, 0, 1);
     zero = zero * parentTransform * transformMatrix;
     printf("position %f %f %f\n", zero.x, zero.y, zero.z);
@@ -1952,3 +2614,12 @@ void SkeletonJoint::slowRender(Mesh& mesh, mat4 parentTransform, bool renderSkel
     for (int childIndex: childrenIndices)
         mesh.joints[childIndex].slowRender(mesh, parentTransform, renderSkeleton);
 }
+
+void SkeletonJoint::updateTransformationMatrix(Mesh& mesh, mat4 parentTransform)
+{
+    transformStack.applyTransforms(parentTransform);
+    transformationMatrix = parentTransform * inverseBindMatrix;
+    
+    for (int childIndex: childrenIndices)
+        mesh.joints[childIndex].updateTransformationMatrix(mesh, parentTransform);
+}
@@ -2,14 +2,22 @@
 #define SGE_COLLADA_MESH_LOADER
 
 #include "Common.h"
+#include "SkinningKernels.h"
+#include "WorkerPool.h"
+#include "BoundingVolumes.h"
+#include "MeshLod.h"
 
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 namespace sge
 {
 
+// poses sampled between two keyframe times for Mesh::animationBounds, besides the keyframes
+const int ANIMATION_BOUNDS_SUBSAMPLES = 4;
+
 // normal mesh architecture:
 // vertices array
 // several indices arrays for multiple materials
@@ -34,9 +42,6 @@ class Vertex
 {
 public :
     vec3 position;
-    vec3 skinnedPosition;
-    
-    void slowRender();
 };
 
 class Polylist
@@ -45,7 +50,15 @@ public :
     MeshMaterial material;
     std::vector<int> indices;
     
-    void slowRender(std::vector<Vertex>& vertices);
+    void slowRender(const PositionArrays& positions);
+};
+
+// coarser version of all polylists over the same vertices
+class MeshLodLevel
+{
+public :
+    // in the order of Mesh::polylists
+    std::vector<std::vector<int>> polylistIndices;
 };
 
 enum class FloatVectorValueType
@@ -101,9 +114,18 @@ enum class TransformationType
 
 class Mesh;
 
+// Keyframes are kept in a compact form since the import: float times (shared between channels
+// using the same COLLADA source) and float values, valueStride floats per key.
+// The sampler-ready track is decoded on the first use and can be evicted by Mesh::enforceAnimationMemoryBudget.
 class AnimationChannel
 {
 public :
+    std::shared_ptr<const std::vector<float>> rawTimes;
+    std::vector<float> rawValues;
+    FloatVectorValueType valueType;
+    int valueStride;
+    
+    // decoded track, empty until the first applyValue
     std::vector<ftype> times;
     std::vector<FloatVectorValue> values;
     
@@ -111,7 +133,21 @@ public :
     int transformIndex;
     int subvalueIndex; // or -1
     
+    // Mesh::animationTick of the last sampling
+    unsigned lastUsedTick = 0;
+    
+    bool isDecoded() const { return !times.empty(); }
+    void decode();
+    void evict();
+    
+    size_t getDecodedSizeBytes() const;
+    
+    ftype getStartTime() const { return rawTimes->front(); }
+    ftype getEndTime() const { return rawTimes->back(); }
+    
     void applyValue(Mesh& to, ftype t);
+    // the same from the compact keyframes, nothing is decoded
+    void applyRawValue(Mesh& to, ftype t) const;
 };
 
 // represents a transformation specified by a floating point values array
@@ -145,16 +181,58 @@ public :
     mat4 transformationMatrix;
     
     void slowRender(Mesh& mesh, mat4 parentTransform, bool renderSkeleton);
+    
+    // same skeleton walk as slowRender, but without any rendering
+    void updateTransformationMatrix(Mesh& mesh, mat4 parentTransform);
+};
+
+// Skin influences in a fixed-width layout: MAX_PACKED_INFLUENCES slots per vertex, heaviest first,
+// unused slots have joint 0 & zero weight. Weights quantized at import are kept as fixed point numbers
+// in bytes or shorts, multiples of 1 / (2^weightBits - 1); with no weight bits they are floats.
+class VertexInfluences
+{
+    int weightBits = 0;
+    
+    std::vector<uint16_t> jointIndices;
+    std::vector<uint8_t> weights8;
+    std::vector<uint16_t> weights16;
+    std::vector<float> floatWeights;
+
+public :
+    // forgets all vertices; 0, 8 or 16 bits
+    void reset(int newWeightBits);
+    
+    // the heaviest MAX_PACKED_INFLUENCES influences are kept & renormalized
+    void add(const std::vector<std::pair<int, ftype>>& influences);
+    
+    int size() const { return (int)jointIndices.size() / MAX_PACKED_INFLUENCES; }
+    int getJoint(int vertex, int slot) const { return jointIndices[vertex * MAX_PACKED_INFLUENCES + slot]; }
+    ftype getWeight(int vertex, int slot) const;
+    
+    size_t getSizeBytes() const;
 };
 
 class Mesh
 {
 public :
     std::vector<Vertex> vertices;
-    std::vector<std::vector<std::pair<int, ftype>>> vertexWeights;
+    VertexInfluences vertexInfluences;
+    
+    // of vertexInfluences, renormalized after the rounding; unused slots get joint 0 with zero weight
+    void getPackedInfluences(int vertex, int jointIndices[MAX_PACKED_INFLUENCES], ftype weights[MAX_PACKED_INFLUENCES]) const;
     
     std::vector<Polylist> polylists;
     
+    // level i + 1 is lods[i], level 0 are the polylists
+    std::vector<MeshLodLevel> lods;
+    
+    // from the bind pose, done by the loader
+    void generateLods(int nLevels);
+    int getLodCount() const { return 1 + (int)lods.size(); }
+    
+    // indices of all polylists of the level, one after another
+    std::vector<int> getLodIndices(int level) const;
+    
     mat4 bindShapeMatrix;
     
     TransformStack armatureTransformStack;
@@ -163,18 +241,105 @@ public :
     
     std::vector<AnimationChannel> animationChannels;
     
+    // bind pose box of the vertices each joint influences, in the space its transformationMatrix is applied to:
+    // a skinned vertex is a weighted sum of its influences, so it lies in the union of the transformed boxes
+    std::vector<AxisAlignedBox> jointBindBoxes;
+    
+    // union of the joint boxes at keyframes & ANIMATION_BOUNDS_SUBSAMPLES times between them, every joint box
+    // swept between consecutive samples & grown by half of how far it moved; conservative for the whole
+    // animation without sampling it, as long as no joint turns by half a turn between two samples
+    AxisAlignedBox animationBounds;
+    
+    // computed by the loader, changes the mesh pose
+    void computeBounds();
+    
+    // joint matrices must be up to date
+    AxisAlignedBox getPoseBounds() const;
+    
+    // decoded animation tracks are evicted, least recently used first, when they take more memory than this;
+    // tracks sampled by the latest applyAnimation are never evicted
+    size_t animationMemoryBudget = 4 * 1024 * 1024;
+    unsigned animationTick = 0;
+    
+    void enforceAnimationMemoryBudget();
+    
     bool renderSkeleton = true;
     
-    void slowRender();
+    // CPU skinning, solid with a wireframe overlay in one pass: the program must be
+    // vertex-shader.glsl compiled with COLORED & WIREFRAME, see wireframe-geometry-shader.glsl
+    void slowRender(GLuint wireframeProgram);
     void slowRenderPass(bool skeletonOnly);
     
+    // skinnedPositions hold the skin of jointPalette
     bool skinned = false;
     
-    void applyAnimation();
+    // vertex positions are premultiplied by bindShapeMatrix once, before the first skinning
+    bool bindShapeApplied = false;
+    void applyBindShapeMatrix();
+    
+    bool animationPaused = false;
+    ftype pausedAnimationTime = 0, animationClockOffset = 0;
+    
+    // the time of the pose currently in the joint transform stacks
+    bool hasSampledTime = false;
+    ftype sampledTime = 0;
+    
+    // paused animation stays at the same pose, resumed continues from it
+    void setAnimationPaused(bool paused);
+    
+    // samples all animation channels at the current clock time;
+    // false if the pose was already sampled at that time and nothing changed
+    bool applyAnimation();
+    bool applyAnimation(ftype t);
+    void updateJointMatrices();
+    
+    // samples the animation & updates joint matrices without skinning, e.g. for a culled mesh
+    void updatePose();
+    
+    // one-off poses of the import passes: the compact keyframes are sampled directly & the joint matrices
+    // updated, no track is decoded; the next applyAnimation samples again
+    void sampleCompactPose(ftype t);
+    
+    // packed copy of vertices & vertexInfluences for skinPositions, built by the first applySkinning
+    PackedSkin packedSkin;
+    std::vector<float> jointPalette, nextJointPalette;
+    
+    // skinnedPositions are rendered while the worker pool fills pendingSkinnedPositions
+    PositionArrays skinnedPositions, pendingSkinnedPositions;
+    TaskGroup skinningTasks;
+    bool skinningPending = false;
+    
+    void packSkin();
+    
+    // beginSkinning starts skinning the current joint matrices in vertex ranges on the worker pool,
+    // finishSkinning waits for it and swaps the result into skinnedPositions;
+    // nothing is skinned when the palette is the same as the one already skinned
+    void beginSkinning();
+    void finishSkinning();
     void applySkinning();
+    
+    ftype getAnimationStartTime() const;
+    ftype getAnimationEndTime() const;
+};
+
+class ColladaImportOptions
+{
+public :
+    // the heaviest influences kept per vertex, 0 keeps all of them
+    int maxInfluences = MAX_PACKED_INFLUENCES;
+    
+    // kept weights are renormalized & rounded to multiples of 1 / (2^weightBits - 1); 8, 16 or 0 to keep them exact
+    int weightBits = 8;
+    
+    // samples the animation to print how far the pruned & quantized weights move the skinned vertices;
+    // skins the whole mesh with both sets of weights in every sampled pose, which slows the import down
+    bool measureSkinningError = false;
+    
+    // simplified levels generated in addition to the full mesh, fewer are kept if the mesh does not simplify further
+    int lodLevels = DEFAULT_LOD_LEVELS;
 };
 
-Mesh loadColladaMeshNew(std::string fileName);
+Mesh loadColladaMeshNew(std::string fileName, const ColladaImportOptions& options = ColladaImportOptions());
 
 }
 
@@ -0,0 +1,179 @@
+#include "DebugDraw.h"
+#include "StreamingBuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+using namespace std;
+using namespace sge;
+
+// per great circle of a sphere
+const int DEBUG_SPHERE_SEGMENTS = 24;
+
+DebugDraw& DebugDraw::instance()
+{
+    static DebugDraw instance;
+    return instance;
+}
+
+void DebugDraw::addVertex(vector<DebugVertex>& vertices, vec3 position, vec4 color)
+{
+    vec3 transformed = vec3(transform * vec4(position, 1));
+    vec4 clamped = glm::clamp(color, 0.0, 1.0);
+    
+    DebugVertex vertex;
+    for (int i = 0; i < 3; i++)
+        vertex.position[i] = (float)transformed[i];
+    for (int i = 0; i < 4; i++)
+        vertex.color[i] = (GLubyte)(clamped[i] * 255 + 0.5);
+    
+    vertices.push_back(vertex);
+}
+
+void DebugDraw::addLine(vec3 a, vec3 b, vec4 color)
+{
+    addVertex(lineVertices, a, color);
+    addVertex(lineVertices, b, color);
+}
+
+void DebugDraw::addTriangle(vec3 a, vec3 b, vec3 c, vec4 color)
+{
+    addVertex(triangleVertices, a, color);
+    addVertex(triangleVertices, b, color);
+    addVertex(triangleVertices, c, color);
+}
+
+// corner i has x, y & z from bits 2, 1 & 0, a set bit is +1
+static vec3 getCubeCorner(const mat4& cubeTransform, int corner)
+{
+    vec4 local((corner & 4) ? 1 : -1, (corner & 2) ? 1 : -1, (corner & 1) ? 1 : -1, 1);
+    return vec3(cubeTransform * local);
+}
+
+void DebugDraw::addBox(const mat4& cubeTransform, vec4 color)
+{
+    // edges join the corners which differ in one bit
+    for (int a = 0; a < 8; a++)
+        for (int bit = 1; bit < 8; bit <<= 1)
+            if (!(a & bit))
+                addLine(getCubeCorner(cubeTransform, a), getCubeCorner(cubeTransform, a | bit), color);
+}
+
+void DebugDraw::addSolidBox(const mat4& cubeTransform, vec4 color)
+{
+    const int quads[6][4] =
+        { { 0, 1, 3, 2 }, { 4, 5, 7, 6 },
+          { 0, 1, 5, 4 }, { 2, 3, 7, 6 },
+          { 0, 2, 6, 4 }, { 1, 3, 7, 5 } };
+    
+    vec3 corners[8];
+    for (int i = 0; i < 8; i++)
+        corners[i] = getCubeCorner(cubeTransform, i);
+    
+    for (const auto& quad: quads)
+    {
+        addTriangle(corners[quad[0]], corners[quad[1]], corners[quad[2]], color);
+        addTriangle(corners[quad[0]], corners[quad[2]], corners[quad[3]], color);
+    }
+}
+
+void DebugDraw::addBox(const AxisAlignedBox& box, vec4 color)
+{
+    if (box.isEmpty())
+        return;
+    
+    mat4 cubeTransform = glm::translate(mat4(), box.getCenter()) * glm::scale(mat4(), box.getHalfExtent());
+    addBox(cubeTransform, color);
+}
+
+void DebugDraw::addSphere(const BoundingSphere& sphere, vec4 color)
+{
+    const vec3 axes[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) };
+    
+    for (int circle = 0; circle < 3; circle++)
+    {
+        vec3 u = axes[circle] * sphere.radius, v = axes[(circle + 1) % 3] * sphere.radius;
+        vec3 previous = sphere.center + u;
+        
+        for (int i = 1; i <= DEBUG_SPHERE_SEGMENTS; i++)
+        {
+            ftype angle = 2 * M_PI * i / DEBUG_SPHERE_SEGMENTS;
+            vec3 next = sphere.center + u * cos(angle) + v * sin(angle);
+            
+            addLine(previous, next, color);
+            previous = next;
+        }
+    }
+}
+
+void DebugDraw::addAxes(const mat4& frame, ftype size)
+{
+    vec3 origin = vec3(frame * vec4(0, 0, 0, 1));
+    
+    for (int axis = 0; axis < 3; axis++)
+    {
+        vec4 direction(0, 0, 0, 1), color(0, 0, 0, 1);
+        direction[axis] = size;
+        color[axis] = 1;
+        
+        addLine(origin, vec3(frame * direction), color);
+    }
+}
+
+void DebugDraw::flush(const mat4& projectionViewMatrix)
+{
+    if (triangleVertices.empty() && lineVertices.empty())
+        return;
+    
+    StreamingBuffer& stream = StreamingBuffer::instance();
+    
+    glUseProgram(0);
+    glDisable(GL_TEXTURE_2D);
+    glLoadMatrixd(glm::value_ptr(projectionViewMatrix));
+    
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    
+    auto draw = [&](const vector<DebugVertex>& vertices, GLenum mode)
+    {
+        if (vertices.empty())
+            return;
+        
+        size_t size = vertices.size() * sizeof(DebugVertex);
+        StreamingAllocation allocation = stream.allocate(size);
+        memcpy(allocation.data, vertices.data(), size);
+        stream.flush();
+        
+        GLsizei stride = sizeof(DebugVertex);
+        
+        glBindBuffer(GL_ARRAY_BUFFER, allocation.buffer);
+        glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)(allocation.offset + offsetof(DebugVertex, position)));
+        glColorPointer(4, GL_UNSIGNED_BYTE, stride, (const GLvoid*)(allocation.offset + offsetof(DebugVertex, color)));
+        
+        glDrawArrays(mode, 0, (GLsizei)vertices.size());
+    };
+    
+    // pushed back, so the lines of the same shapes are not hidden by them
+    glPolygonOffset(1, 1);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    draw(triangleVertices, GL_TRIANGLES);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    
+    draw(lineVertices, GL_LINES);
+    
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    // the current color is undefined after drawing with a color array
+    glColor4d(1, 1, 1, 1);
+    
+    clear();
+}
+
+void DebugDraw::clear()
+{
+    triangleVertices.clear();
+    lineVertices.clear();
+}
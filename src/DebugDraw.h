@@ -0,0 +1,57 @@
+#ifndef SGE_DEBUG_DRAW_H
+#define SGE_DEBUG_DRAW_H
+
+#include "Common.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+class DebugVertex
+{
+public :
+    float position[3];
+    GLubyte color[4];
+};
+
+// Debug shapes of a whole frame, collected on the CPU & drawn by flush in two draws:
+// all triangles, then all lines on top of them. Nothing is drawn unless something was added.
+class DebugDraw
+{
+    std::vector<DebugVertex> triangleVertices, lineVertices;
+    
+    void addVertex(std::vector<DebugVertex>& vertices, vec3 position, vec4 color);
+
+public :
+    // applied to everything added, e.g. the model matrix of the skinned mesh whose skeleton is added
+    mat4 transform;
+    
+    static DebugDraw& instance();
+    
+    void addLine(vec3 a, vec3 b, vec4 color);
+    void addTriangle(vec3 a, vec3 b, vec3 c, vec4 color);
+    
+    // the [-1, 1] cube under cubeTransform, edges or faces
+    void addBox(const mat4& cubeTransform, vec4 color);
+    void addSolidBox(const mat4& cubeTransform, vec4 color);
+    void addBox(const AxisAlignedBox& box, vec4 color);
+    
+    // three great circles
+    void addSphere(const BoundingSphere& sphere, vec4 color);
+    
+    // red, green & blue lines along the x, y & z axes of the frame
+    void addAxes(const mat4& frame, ftype size);
+    
+    int getVertexCount() const { return (int)(triangleVertices.size() + lineVertices.size()); }
+    
+    // draws through StreamingBuffer::instance with the fixed-function pipeline & clears
+    void flush(const mat4& projectionViewMatrix);
+    void clear();
+};
+
+}
+
+#endif // SGE_DEBUG_DRAW_H
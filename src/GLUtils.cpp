@@ -1,4 +1,7 @@
 #include "GLUtils.h"
+#include "Textures.h"
+#include "StreamingBuffer.h"
+#include "DebugDraw.h"
 
 #include <set>
 #include <cmath>
@@ -7,6 +10,7 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <tuple>
 
 using namespace std;
 using namespace sge;
@@ -16,28 +20,149 @@ bool GLSingleTextureMesh::checkIndices()
     if (vertices.size() != textureCoords.size())
         return false;
     
+    if (!textureLayers.empty() && textureLayers.size() != vertices.size())
+        return false;
+    
     for (int index: triangleIndices)
         if (index < 0 || index >= (int)vertices.size())
             return false;
+    
+    for (const SimplifiedTriangles& lod: lods)
+        for (int index: lod.indices)
+            if (index < 0 || index >= (int)vertices.size())
+                return false;
         
     return true;
 }
 
-void GLSingleTextureMesh::render() const
+GLMeshBuffers::~GLMeshBuffers()
+{
+    glDeleteVertexArrays(1, &vertexArray);
+    glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
+}
+
+void GLSingleTextureMesh::upload()
+{
+    SDL_assert(checkIndices());
+    
+    // x y z u v, then the layer for texture arrays
+    const int TEXTURE_COORDS = textureLayers.empty() ? 2 : 3;
+    const int FLOATS_PER_VERTEX = 3 + TEXTURE_COORDS;
+    
+    vector<float> interleaved;
+    interleaved.reserve(vertices.size() * FLOATS_PER_VERTEX);
+    
+    for (unsigned i = 0; i < vertices.size(); i++)
+    {
+        interleaved.push_back((float)vertices[i].x);
+        interleaved.push_back((float)vertices[i].y);
+        interleaved.push_back((float)vertices[i].z);
+        interleaved.push_back((float)textureCoords[i].x);
+        interleaved.push_back((float)textureCoords[i].y);
+        
+        if (!textureLayers.empty())
+            interleaved.push_back((float)textureLayers[i]);
+    }
+    
+    if (!vertices.empty())
+    {
+        vec3 minCorner = vertices[0], maxCorner = vertices[0];
+        for (const vec3& vertex: vertices)
+        {
+            minCorner = glm::min(minCorner, vertex);
+            maxCorner = glm::max(maxCorner, vertex);
+        }
+        
+        boundsCenter = (minCorner + maxCorner) * 0.5;
+    }
+    
+    gpuBuffers = make_shared<GLMeshBuffers>();
+    
+    vector<GLuint> indices;
+    gpuBuffers->lodRanges.addLevel(indices, triangleIndices);
+    for (const SimplifiedTriangles& lod: lods)
+        gpuBuffers->lodRanges.addLevel(indices, lod.indices);
+    
+    glGenVertexArrays(1, &gpuBuffers->vertexArray);
+    glBindVertexArray(gpuBuffers->vertexArray);
+    
+    glGenBuffers(1, &gpuBuffers->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, gpuBuffers->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
+    
+    GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+    
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, nullptr);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(TEXTURE_COORDS, GL_FLOAT, stride, (const GLvoid*)(3 * sizeof(float)));
+    
+    // the same data as generic attributes for the core-vertex-shader.glsl programs
+    glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+    glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+    glEnableVertexAttribArray(TEXTURE_COORDS_ATTRIBUTE);
+    glVertexAttribPointer(TEXTURE_COORDS_ATTRIBUTE, TEXTURE_COORDS, GL_FLOAT, GL_FALSE, stride,
+                          (const GLvoid*)(3 * sizeof(float)));
+    
+    glGenBuffers(1, &gpuBuffers->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuBuffers->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    
+    // the element buffer binding stays in the VAO
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLSingleTextureMesh::render(int lodLevel) const
 {   
+    SDL_assert(gpuBuffers);
+    const LodIndexRanges& ranges = gpuBuffers->lodRanges;
+    
     glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glBegin(GL_TRIANGLES);
+    glBindTexture(textureTarget, textureId);
     
-    for (unsigned i = 0; i < triangleIndices.size(); i++)
+    glBindVertexArray(gpuBuffers->vertexArray);
+    glDrawElements(GL_TRIANGLES, ranges.getIndexCount(lodLevel), GL_UNSIGNED_INT, ranges.getIndexOffset(lodLevel));
+    glBindVertexArray(0);
+}
+
+void GLSingleTextureMesh::renderInstanced(GLint instanceMatrixLocation, GLuint instanceBuffer, size_t bufferOffset,
+                                          int nInstances, int lodLevel) const
+{
+    SDL_assert(gpuBuffers);
+    const LodIndexRanges& ranges = gpuBuffers->lodRanges;
+    
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(textureTarget, textureId);
+    
+    glBindVertexArray(gpuBuffers->vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    
+    // instance attributes are switched off after the draw, the VAO is left as upload made it
+    for (int column = 0; column < 4; column++)
     {
-        const vec3& vertex = vertices[triangleIndices[i]];
-        const vec2& texCoords = textureCoords[triangleIndices[i]];
-        glTexCoord2d(texCoords.x, texCoords.y);
-        glVertex3d(vertex.x, vertex.y, vertex.z);
+        GLuint location = (GLuint)(instanceMatrixLocation + column);
+        
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (const GLvoid*)(bufferOffset + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
     }
     
-    glEnd();
+    glDrawElementsInstanced(GL_TRIANGLES, ranges.getIndexCount(lodLevel), GL_UNSIGNED_INT,
+                            ranges.getIndexOffset(lodLevel), nInstances);
+    
+    for (int column = 0; column < 4; column++)
+    {
+        GLuint location = (GLuint)(instanceMatrixLocation + column);
+        
+        glVertexAttribDivisor(location, 0);
+        glDisableVertexAttribArray(location);
+    }
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 // FIXME: remove this class & all mesh decomposition bicycles completely
@@ -77,18 +202,60 @@ struct UniqueVertex
     }
 };
 
-void GLSimpleMesh::render() const
+void GLSimpleMesh::render(int lodLevel) const
 {
     SDL_assert(!singleTextureMeshDecomposition.empty());
     
     for (const auto& subMesh: singleTextureMeshDecomposition)
-        subMesh.render();
+        subMesh.render(lodLevel);
+}
+
+void GLSimpleMesh::renderInstanced(GLint instanceMatrixLocation, GLuint instanceBuffer, size_t bufferOffset,
+                                   int nInstances, int lodLevel) const
+{
+    SDL_assert(!singleTextureMeshDecomposition.empty());
+    
+    for (const auto& subMesh: singleTextureMeshDecomposition)
+        subMesh.renderInstanced(instanceMatrixLocation, instanceBuffer, bufferOffset, nInstances, lodLevel);
+}
+
+void GLSimpleMesh::computeBounds()
+{
+    bounds = AxisAlignedBox();
+    
+    for (const GLSimpleFace& face: faces)
+        for (const vec3& vertex: face.vertices)
+            bounds.add(vertex);
+    
+    if (bounds.isEmpty())
+    {
+        boundingSphere = BoundingSphere();
+        return;
+    }
+    
+    // centered at the box, tighter than its circumscribed sphere
+    boundingSphere = BoundingSphere(bounds.getCenter(), 0);
+    
+    for (const GLSimpleFace& face: faces)
+        for (const vec3& vertex: face.vertices)
+            boundingSphere.radius = max(boundingSphere.radius, glm::length(vertex - boundingSphere.center));
+}
+
+void GLSimpleMesh::makeOccluder()
+{
+    occluderTriangles.clear();
+    
+    for (const GLSimpleFace& face: faces)
+        for (unsigned i = 1; i + 1 < face.vertices.size(); i++)
+            occluderTriangles.insert(occluderTriangles.end(), { face.vertices[0], face.vertices[i], face.vertices[i + 1] });
 }
 
 void GLSimpleMesh::decomposeIntoSingleTextureMeshes()
 {
     SDL_assert(singleTextureMeshDecomposition.empty());
     
+    computeBounds();
+    
     sort(faces.begin(), faces.end(), [] (const GLSimpleFace& a, const GLSimpleFace& b) { return a.textureId < b.textureId; });
         
     set<UniqueVertex> currentVertexSet;
@@ -165,6 +332,129 @@ void GLSimpleMesh::decomposeIntoSingleTextureMeshes()
             }
         }
     }
+    
+    generateLods();
+    buildTextureArrayMesh();
+}
+
+void GLSimpleMesh::generateLods(int nLevels)
+{
+    // vertices with the same position & texture coords are welded; vertices of texture seams & submesh borders
+    // keep the same position in different welded vertices, which the simplifier never moves
+    vector<vec3> positions;
+    vector<int> weldedSource, indices, triangleSubMesh, firstTriangle;
+    map<tuple<int, ftype, ftype, ftype, ftype, ftype>, int> weldedByKey;
+    
+    for (int s = 0; s < (int)singleTextureMeshDecomposition.size(); s++)
+    {
+        GLSingleTextureMesh& subMesh = singleTextureMeshDecomposition[s];
+        subMesh.lods.clear();
+        firstTriangle.push_back((int)triangleSubMesh.size());
+        
+        vector<int> welded(subMesh.vertices.size());
+        
+        for (int i = 0; i < (int)subMesh.vertices.size(); i++)
+        {
+            vec3 vertex = subMesh.vertices[i];
+            vec2 textureCoords = subMesh.textureCoords[i];
+            
+            auto key = make_tuple(s, vertex.x, vertex.y, vertex.z, textureCoords.x, textureCoords.y);
+            auto inserted = weldedByKey.insert(make_pair(key, (int)positions.size()));
+            
+            if (inserted.second)
+            {
+                positions.push_back(vertex);
+                weldedSource.push_back(i);
+            }
+            
+            welded[i] = inserted.first->second;
+        }
+        
+        for (int index: subMesh.triangleIndices)
+            indices.push_back(welded[index]);
+        
+        triangleSubMesh.resize(indices.size() / 3, s);
+    }
+    
+    nLods = 1;
+    
+    if (!indices.empty() && boundingSphere.radius > 0)
+    {
+        ftype maxError = boundingSphere.radius * LOD_MAX_RELATIVE_ERROR;
+        
+        for (const SimplifiedTriangles& level: generateLodLevels(positions, indices, nLevels, maxError))
+        {
+            for (GLSingleTextureMesh& subMesh: singleTextureMeshDecomposition)
+            {
+                subMesh.lods.push_back(SimplifiedTriangles());
+                subMesh.lods.back().error = level.error;
+            }
+            
+            // a collapse never leaves a triangle, so all corners are in the submesh of the source triangle
+            for (int t = 0; t < level.getTriangleCount(); t++)
+            {
+                int source = level.sourceTriangles[t];
+                int s = triangleSubMesh[source];
+                SimplifiedTriangles& lod = singleTextureMeshDecomposition[s].lods.back();
+                
+                for (int corner = 0; corner < 3; corner++)
+                    lod.indices.push_back(weldedSource[level.indices[t * 3 + corner]]);
+                
+                lod.sourceTriangles.push_back(source - firstTriangle[s]);
+            }
+            
+            nLods++;
+        }
+    }
+    
+    for (GLSingleTextureMesh& subMesh: singleTextureMeshDecomposition)
+        subMesh.upload();
+}
+
+bool GLSimpleMesh::buildTextureArrayMesh()
+{
+    textureArrayMesh = GLSingleTextureMesh();
+    
+    if (singleTextureMeshDecomposition.size() < 2)
+        return false;
+    
+    // layer i is the texture of submesh i
+    vector<GLuint> layerTextures;
+    for (const GLSingleTextureMesh& subMesh: singleTextureMeshDecomposition)
+        layerTextures.push_back(subMesh.textureId);
+    
+    const TextureArray* textureArray = TextureManager::instance().retrieveTextureArray(layerTextures);
+    if (!textureArray)
+        return false;
+    
+    textureArrayMesh.textureId = textureArray->openglId;
+    textureArrayMesh.textureTarget = GL_TEXTURE_2D_ARRAY;
+    textureArrayMesh.lods.resize(nLods - 1);
+    
+    for (int layer = 0; layer < (int)singleTextureMeshDecomposition.size(); layer++)
+    {
+        const GLSingleTextureMesh& subMesh = singleTextureMeshDecomposition[layer];
+        GLSingleTextureMesh& mesh = textureArrayMesh;
+        int firstVertex = (int)mesh.vertices.size();
+        
+        mesh.vertices.insert(mesh.vertices.end(), subMesh.vertices.begin(), subMesh.vertices.end());
+        mesh.textureCoords.insert(mesh.textureCoords.end(), subMesh.textureCoords.begin(), subMesh.textureCoords.end());
+        mesh.textureLayers.resize(mesh.vertices.size(), (ftype)layer);
+        
+        // submeshes with fewer levels repeat their coarsest one
+        for (int level = 0; level < nLods; level++)
+        {
+            int sourceLevel = min(level, (int)subMesh.lods.size());
+            const vector<int>& source = sourceLevel == 0 ? subMesh.triangleIndices : subMesh.lods[sourceLevel - 1].indices;
+            vector<int>& target = level == 0 ? mesh.triangleIndices : mesh.lods[level - 1].indices;
+            
+            for (int index: source)
+                target.push_back(firstVertex + index);
+        }
+    }
+    
+    textureArrayMesh.upload();
+    return true;
 }
 
 void colorf(vec3 vec)
@@ -357,35 +647,19 @@ void CharacterController::processCollisionsAgainstMesh(GLPositionedMesh& mesh, C
 
 void CharacterController::dumpRenderCollisionsAgainstMesh(GLPositionedMesh& mesh)
 {
-    glEnable(GL_COLOR_MATERIAL);
-    glDisable(GL_TEXTURE_2D);
- 
-    if (false)
-        glPolygonOffset(-1, -1);
-    else
-        glPolygonOffset(1, 1);
-    glEnable(GL_POLYGON_OFFSET_FILL);
-    
-    glBegin(GL_TRIANGLES);
-    glColor3f(0.75, 0.75, 0.75);
+    DebugDraw& debugDraw = DebugDraw::instance();
+    vec4 color(0.75, 0.75, 0.75, 1);
     
+    // faces are convex polygons, added as fans of triangles
     for (GLSimpleFace& face: mesh.baseMesh->faces)
     {
         vector<vec3> vertices = face.vertices;
         for (auto& v: vertices)
             v = vec3(mesh.modelMatrix * extendPositionVector(v));
         
-        glBegin(GL_POLYGON);
-        for (auto it: vertices)
-            glVertex3d(it.x, it.y, it.z);
-        glEnd();
+        for (int i = 2; i < (int)vertices.size(); i++)
+            debugDraw.addTriangle(vertices[0], vertices[i - 1], vertices[i], color);
     }
-    
-    glDisable(GL_POLYGON_OFFSET_FILL);
-    
-    // otherwise it would blend, dunno why
-    glColor3f(1, 1, 1);
-    glDisable(GL_COLOR_MATERIAL);
 }
 
 ftype absTriangleSquare(const vec3& a, const vec3& b, const vec3& c)
@@ -512,10 +786,11 @@ void CharacterController::processCollisionsAgainstTriangle(GLSimpleFace& generat
     }
 }*/
 
-void SimpleWorldContainer::addPositionedMesh(GLSimpleMesh& baseMesh, vec3 position)
+void SimpleWorldContainer::addPositionedMesh(GLSimpleMesh& baseMesh, vec3 position, bool isStatic)
 {
     GLPositionedMesh mesh = GLPositionedMesh();
     mesh.baseMesh = &baseMesh;
+    mesh.isStatic = isStatic;
     mesh.modelMatrix = glm::translate(mesh.modelMatrix, position);
     //mesh.inverseModelMatrix = glm::translate(mesh.inverseModelMatrix, -position);
     
@@ -524,13 +799,505 @@ void SimpleWorldContainer::addPositionedMesh(GLSimpleMesh& baseMesh, vec3 positi
     positionedMeshes.push_back(mesh);
 }
 
-void SimpleWorldContainer::renderWorld(mat4 projectionViewMatrix)
+void SimpleWorldContainer::buildCells()
+{
+    cellGraph.clear();
+    positionedMeshCell.assign(positionedMeshes.size(), -1);
+    
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        int cell = -1;
+        
+        for (const MeshMarker& marker: positionedMesh.baseMesh->markers)
+        {
+            if (marker.polygon.empty())
+                continue;
+            
+            if (cell < 0)
+                cell = cellGraph.addCell(positionedMesh.baseMesh->bounds.transformed(positionedMesh.modelMatrix));
+            
+            vector<vec3> worldPolygon;
+            for (const vec3& point: marker.polygon)
+                worldPolygon.push_back(vec3(positionedMesh.modelMatrix * vec4(point, 1)));
+            
+            cellGraph.addPortal(cell, worldPolygon);
+        }
+        
+        positionedMeshCell[i] = cell;
+    }
+    
+    if (cellGraph.cells.empty())
+        return;
+    
+    int nDoorways = cellGraph.connectPortals();
+    
+    // props are assigned to the room they stand in
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if (positionedMeshCell[i] < 0)
+        {
+            AxisAlignedBox worldBounds = positionedMesh.baseMesh->bounds.transformed(positionedMesh.modelMatrix);
+            positionedMeshCell[i] = cellGraph.findCell(worldBounds.getCenter());
+        }
+    }
+    
+    printf("%d cells, %d doorways, %d portals lead nowhere\n", (int)cellGraph.cells.size(), nDoorways,
+           (int)cellGraph.portals.size() - nDoorways * 2);
+}
+
+void SimpleWorldContainer::bakeStaticBatches()
 {
+    staticBatches.clear();
+    
+    // texture, cell, chunk; batches never span rooms, so portals cull them as well
+    map<tuple<GLuint, int, int, int, int>, int> batchByKey;
+    
+    int nBaked = 0, nLeftOut = 0;
+    
+    map<const GLSimpleMesh*, int> baseMeshUses;
+    for (const GLPositionedMesh& positionedMesh: positionedMeshes)
+        baseMeshUses[positionedMesh.baseMesh]++;
+    
+    // every batch gets the levels of the most detailed static mesh, meshes with fewer levels add their coarsest one
+    int nLevels = 1;
     for (GLPositionedMesh& positionedMesh: positionedMeshes)
     {
+        bool instanced = instanceRepeatedMeshes && baseMeshUses[positionedMesh.baseMesh] > 1;
+        positionedMesh.inStaticBatch = positionedMesh.isStatic && !instanced && !useOcclusionQueries;
+        
+        if (positionedMesh.inStaticBatch)
+        {
+            nBaked++;
+            nLevels = max(nLevels, positionedMesh.baseMesh->nLods);
+        }
+        else if (positionedMesh.isStatic)
+            nLeftOut++;
+    }
+    
+    for (int meshIndex = 0; meshIndex < (int)positionedMeshes.size(); meshIndex++)
+    {
+        GLPositionedMesh& positionedMesh = positionedMeshes[meshIndex];
+        
+        if (!positionedMesh.inStaticBatch)
+            continue;
+        
+        int cell = meshIndex < (int)positionedMeshCell.size() ? positionedMeshCell[meshIndex] : -1;
+        
+        for (const GLSingleTextureMesh& subMesh: positionedMesh.baseMesh->singleTextureMeshDecomposition)
+        {
+            vector<vec3> worldVertices(subMesh.vertices.size());
+            for (unsigned i = 0; i < worldVertices.size(); i++)
+                worldVertices[i] = vec3(positionedMesh.modelMatrix * vec4(subMesh.vertices[i], 1));
+            
+            // batch of every full detail triangle, simplified triangles go to the batch of their source triangle
+            vector<int> triangleBatch;
+            
+            for (unsigned i = 0; i + 2 < subMesh.triangleIndices.size(); i += 3)
+            {
+                const int* triangle = &subMesh.triangleIndices[i];
+                vec3 chunk = glm::floor((worldVertices[triangle[0]] + worldVertices[triangle[1]] + worldVertices[triangle[2]])
+                                        / (3 * staticChunkSize));
+                
+                auto key = make_tuple(subMesh.textureId, cell, (int)chunk.x, (int)chunk.y, (int)chunk.z);
+                auto found = batchByKey.find(key);
+                
+                if (found == batchByKey.end())
+                {
+                    found = batchByKey.insert(make_pair(key, (int)staticBatches.size())).first;
+                    staticBatches.push_back(StaticBatch());
+                    staticBatches.back().mesh.textureId = subMesh.textureId;
+                    staticBatches.back().mesh.lods.resize(nLevels - 1);
+                    staticBatches.back().cell = cell;
+                }
+                
+                triangleBatch.push_back(found->second);
+            }
+            
+            // batch index of every submesh vertex, per batch it was copied to
+            map<int, vector<int>> remapByBatch;
+            
+            for (int level = 0; level < nLevels; level++)
+            {
+                int sourceLevel = min(level, (int)subMesh.lods.size());
+                const vector<int>& levelIndices = sourceLevel == 0 ? subMesh.triangleIndices
+                                                                   : subMesh.lods[sourceLevel - 1].indices;
+                
+                for (int t = 0; t * 3 + 2 < (int)levelIndices.size(); t++)
+                {
+                    int source = sourceLevel == 0 ? t : subMesh.lods[sourceLevel - 1].sourceTriangles[t];
+                    
+                    StaticBatch& batch = staticBatches[triangleBatch[source]];
+                    vector<int>& batchIndices = level == 0 ? batch.mesh.triangleIndices : batch.mesh.lods[level - 1].indices;
+                    
+                    vector<int>& remap = remapByBatch[triangleBatch[source]];
+                    if (remap.empty())
+                        remap.assign(subMesh.vertices.size(), -1);
+                    
+                    for (int corner = 0; corner < 3; corner++)
+                    {
+                        int vertex = levelIndices[t * 3 + corner];
+                        
+                        if (remap[vertex] < 0)
+                        {
+                            remap[vertex] = (int)batch.mesh.vertices.size();
+                            batch.mesh.vertices.push_back(worldVertices[vertex]);
+                            batch.mesh.textureCoords.push_back(subMesh.textureCoords[vertex]);
+                            batch.bounds.add(worldVertices[vertex]);
+                        }
+                        
+                        batchIndices.push_back(remap[vertex]);
+                    }
+                }
+            }
+        }
+    }
+    
+    // trailing levels made only of the coarsest levels of their meshes repeat the previous level
+    for (StaticBatch& batch: staticBatches)
+    {
+        vector<SimplifiedTriangles>& lods = batch.mesh.lods;
+        
+        while (!lods.empty())
+        {
+            const vector<int>& previous = lods.size() > 1 ? lods[lods.size() - 2].indices : batch.mesh.triangleIndices;
+            if (lods.back().indices.size() != previous.size())
+                break;
+            
+            lods.pop_back();
+        }
+    }
+    
+    for (StaticBatch& batch: staticBatches)
+        batch.mesh.upload();
+    
+    printf("%d static meshes baked into %d batches, %d left out for instancing or queries\n",
+           nBaked, (int)staticBatches.size(), nLeftOut);
+}
+
+void SimpleWorldContainer::cullPositionedMeshes(mat4 projectionViewMatrix)
+{
+    frustum = Frustum(projectionViewMatrix);
+    worldBoxes.clear();
+    
+    for (const GLPositionedMesh& positionedMesh: positionedMeshes)
+    {
+        // the sphere rejects cheaply, the box of whatever is left is tested in a batch
+        if (frustum.isOutside(positionedMesh.baseMesh->boundingSphere.transformed(positionedMesh.modelMatrix)))
+            worldBoxes.add(AxisAlignedBox());
+        else
+            worldBoxes.add(positionedMesh.baseMesh->bounds.transformed(positionedMesh.modelMatrix));
+    }
+    
+    testBoxesAgainstFrustum(frustum, worldBoxes, positionedMeshVisible);
+    
+    portalCulling = usePortals && !cellGraph.cells.empty() &&
+                    cellGraph.computeVisibility(projectionViewMatrix, getCameraPosition(projectionViewMatrix));
+    
+    // portals already hide whatever walls would
+    occlusionCulling = useOcclusionCulling && !portalCulling;
+    
+    if (occlusionCulling)
+        cullOccludedMeshes(projectionViewMatrix);
+    
+    if (!portalCulling)
+        return;
+    
+    cellFrusta.resize(cellGraph.cells.size());
+    for (int cell = 0; cell < (int)cellGraph.cells.size(); cell++)
+        if (cellGraph.cellVisible[cell])
+            cellFrusta[cell] = Frustum(cellGraph.cellRects[cell].getClipMatrix() * projectionViewMatrix);
+    
+    for (int i = 0; i < (int)positionedMeshes.size() && i < (int)positionedMeshCell.size(); i++)
+    {
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if (!positionedMeshVisible[i])
+            continue;
+        
+        AxisAlignedBox worldBounds = positionedMesh.baseMesh->bounds.transformed(positionedMesh.modelMatrix);
+        if (isCulledByPortals(positionedMeshCell[i], worldBounds))
+            positionedMeshVisible[i] = 0;
+    }
+}
+
+void SimpleWorldContainer::cullOccludedMeshes(mat4 projectionViewMatrix)
+{
+    occlusionBuffer.clear(projectionViewMatrix);
+    
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if (positionedMeshVisible[i] && !positionedMesh.baseMesh->occluderTriangles.empty())
+            occlusionBuffer.addOccluder(positionedMesh.baseMesh->occluderTriangles, positionedMesh.modelMatrix);
+    }
+    
+    occlusionBuffer.rasterize();
+    
+    // occluders are tested too, a wall behind another wall is hidden as well
+    occlusionBuffer.testBoxes(worldBoxes, positionedMeshVisible);
+}
+
+bool SimpleWorldContainer::isCulledByPortals(int cell, const AxisAlignedBox& worldBounds) const
+{
+    // meshes outside of every cell are only frustum culled
+    if (!portalCulling || cell < 0)
+        return false;
+    
+    return !cellGraph.cellVisible[cell] || cellFrusta[cell].isOutside(worldBounds);
+}
+
+int SimpleWorldContainer::selectLod(int currentLevel, const BoundingSphere& worldSphere, int nLevels,
+                                    const mat4& projectionViewMatrix) const
+{
+    if (!useLods || nLevels <= 1)
+        return 0;
+    
+    return lodSelector.select(currentLevel, getProjectedSize(projectionViewMatrix, worldSphere), nLevels);
+}
+
+void SimpleWorldContainer::addStaticBatchesToQueue(mat4 projectionViewMatrix, GLuint program)
+{
+    for (StaticBatch& batch: staticBatches)
+    {
+        if (frustum.isOutside(batch.bounds) || isCulledByPortals(batch.cell, batch.bounds))
+            continue;
+        
+        if (occlusionCulling && occlusionBuffer.isOccluded(batch.bounds))
+            continue;
+        
+        BoundingSphere sphere(batch.bounds.getCenter(), glm::length(batch.bounds.getHalfExtent()));
+        batch.lodLevel = selectLod(batch.lodLevel, sphere, 1 + (int)batch.mesh.lods.size(), projectionViewMatrix);
+        
+        ftype viewDepth = (projectionViewMatrix * vec4(batch.bounds.getCenter(), 1)).w;
+        renderQueue.add(RenderPass::OPAQUE, program, batch.mesh, mat4(), viewDepth, batch.lodLevel);
+    }
+}
+
+void SimpleWorldContainer::renderOcclusionQueries(mat4 projectionViewMatrix, GLuint program)
+{
+    vec3 cameraPosition = getCameraPosition(projectionViewMatrix);
+    vector<int> hiddenMeshes;
+    
+    occlusionQueries.beginQueries();
+    
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if ((useStaticBatches && positionedMesh.inStaticBatch) || !positionedMeshVisible[i])
+            continue;
+        
+        AxisAlignedBox worldBox = positionedMesh.baseMesh->bounds.transformed(positionedMesh.modelMatrix);
+        
+        // the near plane may cut away the front of a box around the camera, its query would find nothing
+        vec3 outside = glm::abs(cameraPosition - worldBox.getCenter()) - worldBox.getHalfExtent();
+        
+        if (max(outside.x, max(outside.y, outside.z)) < OCCLUSION_QUERY_CAMERA_DISTANCE)
+        {
+            occlusionQueries.markVisible(i);
+            continue;
+        }
+        
+        occlusionQueries.issueQuery(i, projectionViewMatrix, worldBox);
+        
+        if (!occlusionQueries.isVisible(i) && occlusionQueries.hasQuery(i))
+            hiddenMeshes.push_back(i);
+    }
+    
+    occlusionQueries.endQueries();
+    
+    if (hiddenMeshes.empty())
+        return;
+    
+    glUseProgram(program);
+    
+    bool drawUniforms = usesDrawUniforms(program);
+    vector<size_t> drawUniformOffsets;
+    
+    if (drawUniforms)
+    {
+        occlusionDrawUniforms.clear();
+        for (int i: hiddenMeshes)
+            drawUniformOffsets.push_back(occlusionDrawUniforms.add(positionedMeshes[i].modelMatrix));
+        
+        occlusionDrawUniforms.upload();
+    }
+    
+    for (int hidden = 0; hidden < (int)hiddenMeshes.size(); hidden++)
+    {
+        int i = hiddenMeshes[hidden];
+        const GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        occlusionQueries.beginConditionalRender(i);
+        
+        if (drawUniforms)
+            occlusionDrawUniforms.bind(drawUniformOffsets[hidden]);
+        else
+            glLoadMatrixd(glm::value_ptr(projectionViewMatrix * positionedMesh.modelMatrix));
+        
+        for (const GLSingleTextureMesh& subMesh: positionedMesh.baseMesh->singleTextureMeshDecomposition)
+            subMesh.render(positionedMesh.lodLevel);
+        
+        occlusionQueries.endConditionalRender();
+    }
+}
+
+void SimpleWorldContainer::renderWorld(mat4 projectionViewMatrix, GLuint program, GLuint textureArrayProgram)
+{
+    renderQueue.clear();
+    cullPositionedMeshes(projectionViewMatrix);
+    
+    if (useOcclusionQueries)
+        occlusionQueries.collectResults((int)positionedMeshes.size());
+    
+    if (useStaticBatches)
+        addStaticBatchesToQueue(projectionViewMatrix, program);
+    
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if ((useStaticBatches && positionedMesh.inStaticBatch) || !positionedMeshVisible[i])
+            continue;
+        
         mat4 meshMatrix = projectionViewMatrix * positionedMesh.modelMatrix;
-        glLoadMatrixd(glm::value_ptr(meshMatrix));
-        positionedMesh.baseMesh->render();
+        const GLSimpleMesh& baseMesh = *positionedMesh.baseMesh;
+        
+        // also for the meshes drawn by renderOcclusionQueries
+        BoundingSphere worldSphere = baseMesh.boundingSphere.transformed(positionedMesh.modelMatrix);
+        positionedMesh.lodLevel = selectLod(positionedMesh.lodLevel, worldSphere, baseMesh.nLods, projectionViewMatrix);
+        
+        // hidden meshes are drawn by renderOcclusionQueries if their query passes
+        if (useOcclusionQueries && !occlusionQueries.isVisible(i))
+            continue;
+        
+        if (textureArrayProgram && baseMesh.hasTextureArrayMesh())
+        {
+            const GLSingleTextureMesh& arrayMesh = baseMesh.textureArrayMesh;
+            ftype viewDepth = (meshMatrix * vec4(arrayMesh.boundsCenter, 1)).w;
+            renderQueue.add(RenderPass::OPAQUE, textureArrayProgram, arrayMesh, positionedMesh.modelMatrix, viewDepth,
+                            positionedMesh.lodLevel);
+            continue;
+        }
+        
+        for (const GLSingleTextureMesh& subMesh: baseMesh.singleTextureMeshDecomposition)
+        {
+            // w of a perspective projection is the view depth
+            ftype viewDepth = (meshMatrix * vec4(subMesh.boundsCenter, 1)).w;
+            renderQueue.add(RenderPass::OPAQUE, program, subMesh, positionedMesh.modelMatrix, viewDepth,
+                            positionedMesh.lodLevel);
+        }
+    }
+    
+    renderQueue.submit(projectionViewMatrix);
+    
+    if (useOcclusionQueries)
+        renderOcclusionQueries(projectionViewMatrix, program);
+}
+
+// binds the program for instanced draws, returns its instance matrix attribute
+static GLint useInstancedProgram(GLuint program, const glm::mat4& projectionView)
+{
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projectionViewMatrix"), 1, GL_FALSE, glm::value_ptr(projectionView));
+    
+    GLint instanceMatrixLocation = glGetAttribLocation(program, "instanceModelMatrix");
+    verify(instanceMatrixLocation >= 0, "Instanced program must use the 'instanceModelMatrix' attribute.");
+    
+    return instanceMatrixLocation;
+}
+
+void SimpleWorldContainer::renderWorldInstanced(mat4 projectionViewMatrix, GLuint instancedProgram, GLuint staticProgram,
+                                                GLuint instancedTextureArrayProgram)
+{
+    cullPositionedMeshes(projectionViewMatrix);
+    
+    if (useStaticBatches)
+    {
+        renderQueue.clear();
+        addStaticBatchesToQueue(projectionViewMatrix, staticProgram);
+        renderQueue.submit(projectionViewMatrix);
+    }
+    
+    // base mesh & level of detail; groups in the order of their first appearance
+    typedef pair<GLSimpleMesh*, int> InstanceGroup;
+    vector<InstanceGroup> groups;
+    map<InstanceGroup, vector<glm::mat4>> groupMatrices;
+    
+    for (int i = 0; i < (int)positionedMeshes.size(); i++)
+    {
+        GLPositionedMesh& positionedMesh = positionedMeshes[i];
+        
+        if ((useStaticBatches && positionedMesh.inStaticBatch) || !positionedMeshVisible[i])
+            continue;
+        
+        GLSimpleMesh* baseMesh = positionedMesh.baseMesh;
+        BoundingSphere worldSphere = baseMesh->boundingSphere.transformed(positionedMesh.modelMatrix);
+        positionedMesh.lodLevel = selectLod(positionedMesh.lodLevel, worldSphere, baseMesh->nLods, projectionViewMatrix);
+        
+        InstanceGroup group(baseMesh, positionedMesh.lodLevel);
+        
+        vector<glm::mat4>& matrices = groupMatrices[group];
+        if (matrices.empty())
+            groups.push_back(group);
+        
+        matrices.push_back(glm::mat4(positionedMesh.modelMatrix));
+    }
+    
+    if (groups.empty())
+        return;
+    
+    // groups drawn through texture arrays go last, so the program is switched once
+    auto usesTextureArray = [&](const InstanceGroup& group)
+    {
+        return instancedTextureArrayProgram && group.first->hasTextureArrayMesh();
+    };
+    stable_partition(groups.begin(), groups.end(), [&](const InstanceGroup& group) { return !usesTextureArray(group); });
+    
+    size_t nInstancesTotal = 0;
+    for (const InstanceGroup& group: groups)
+        nInstancesTotal += groupMatrices[group].size();
+    
+    StreamingBuffer& stream = StreamingBuffer::instance();
+    StreamingAllocation instanceData = stream.allocate(nInstancesTotal * sizeof(glm::mat4));
+    
+    glm::mat4* instanceMatrices = (glm::mat4*)instanceData.data;
+    for (const InstanceGroup& group: groups)
+        instanceMatrices = copy(groupMatrices[group].begin(), groupMatrices[group].end(), instanceMatrices);
+    
+    stream.flush();
+    
+    glm::mat4 projectionView(projectionViewMatrix);
+    GLint instanceMatrixLocation = useInstancedProgram(instancedProgram, projectionView);
+    bool textureArrayProgramBound = false;
+    
+    size_t firstInstance = 0;
+    
+    for (const InstanceGroup& group: groups)
+    {
+        int nInstances = (int)groupMatrices[group].size();
+        size_t bufferOffset = instanceData.offset + firstInstance * sizeof(glm::mat4);
+        
+        if (usesTextureArray(group))
+        {
+            if (!textureArrayProgramBound)
+            {
+                instanceMatrixLocation = useInstancedProgram(instancedTextureArrayProgram, projectionView);
+                textureArrayProgramBound = true;
+            }
+            
+            group.first->textureArrayMesh.renderInstanced(instanceMatrixLocation, instanceData.buffer, bufferOffset,
+                                                          nInstances, group.second);
+        }
+        else
+            group.first->renderInstanced(instanceMatrixLocation, instanceData.buffer, bufferOffset, nInstances,
+                                         group.second);
+        
+        firstInstance += nInstances;
     }
 }
 
@@ -2,29 +2,73 @@
 #define GL_UTILS_H
 
 #include "Common.h"
+#include "RenderQueue.h"
+#include "BoundingVolumes.h"
+#include "PortalVisibility.h"
+#include "OcclusionCulling.h"
+#include "MeshLod.h"
+#include "UniformBuffers.h"
 
 #include <vector>
 #include <string>
+#include <memory>
 
 namespace sge
 {
 
+// Vertex array object with an interleaved float position & texture coords buffer and an index buffer,
+// fixed function client array state is recorded in the VAO. Deleted with the last mesh sharing it.
+class GLMeshBuffers
+{
+public :
+    GLuint vertexArray = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    
+    // every level of detail is a range of the index buffer
+    LodIndexRanges lodRanges;
+    
+    GLMeshBuffers() {}
+    GLMeshBuffers(const GLMeshBuffers&) = delete;
+    GLMeshBuffers& operator=(const GLMeshBuffers&) = delete;
+    ~GLMeshBuffers();
+};
+
 // It is possible to render multi-texture meshes without context switches
 // By supplying the vertex shader texture ids (~kinda)
-// We split into similar texture parts instead
+// We split into similar texture parts instead; GLSimpleMesh::textureArrayMesh does the former
 class GLSingleTextureMesh
 {
 public :
     GLuint textureId = 0;
+    GLenum textureTarget = GL_TEXTURE_2D;
     
     std::vector<vec3> vertices;
     
     // attached to vertices
     std::vector<vec2> textureCoords;
     
+    // GL_TEXTURE_2D_ARRAY layer of every vertex, empty for 2D textures; uploaded as the third texture coordinate
+    std::vector<ftype> textureLayers;
+    
     std::vector<int> triangleIndices;
     
-    void render() const;
+    // coarser levels over the same vertices, lods[i] is level i + 1; see GLSimpleMesh::generateLods
+    std::vector<SimplifiedTriangles> lods;
+    
+    // center of the vertices bounding box, set by upload
+    vec3 boundsCenter;
+    
+    // copies of the mesh share the buffers
+    std::shared_ptr<GLMeshBuffers> gpuBuffers;
+    
+    // must be called once the mesh is complete, render draws only what was uploaded
+    void upload();
+    void render(int lodLevel = 0) const;
+    
+    // model matrices are read as 4 consecutive vec4 attributes starting at instanceMatrixLocation
+    void renderInstanced(GLint instanceMatrixLocation, GLuint instanceBuffer, size_t bufferOffset, int nInstances,
+                         int lodLevel = 0) const;
     
     bool checkIndices();
 };
@@ -46,6 +90,9 @@ class MeshMarker
 public :
     std::string name;
     vec3 position, direction;
+    
+    // doorway of a room mesh, in mesh space; empty for point markers
+    std::vector<vec3> polygon;
 };
 
 class GLSimpleMesh
@@ -55,12 +102,39 @@ public :
     std::vector<GLSingleTextureMesh> singleTextureMeshDecomposition;
     std::vector<MeshMarker> markers;
     
-    // may sort faces
+    // of all face vertices, in mesh space
+    AxisAlignedBox bounds;
+    BoundingSphere boundingSphere;
+    
+    // fan triangulated faces for OcclusionBuffer, empty unless makeOccluder was called
+    std::vector<vec3> occluderTriangles;
+    
+    // levels of detail including the full one, every submesh has at most this many
+    int nLods = 1;
+    
+    // all submeshes with the texture layer as the third texture coordinate, drawn in one call
+    // by programs compiled with TEXTURE_ARRAY; empty unless buildTextureArrayMesh succeeded
+    GLSingleTextureMesh textureArrayMesh;
+    bool hasTextureArrayMesh() const { return textureArrayMesh.gpuBuffers != nullptr; }
+    
+    // may sort faces; computes bounds & levels of detail too
     void decomposeIntoSingleTextureMeshes();
+    void computeBounds();
+    
+    // simplifies all submeshes together, so texture borders stay closed; bounds must be computed, uploads the submeshes
+    void generateLods(int nLevels = DEFAULT_LOD_LEVELS);
+    
+    // after generateLods; false for meshes with a single texture or with textures of different sizes
+    bool buildTextureArrayMesh();
+    
+    // big & low-poly meshes only: walls, floors
+    void makeOccluder();
     
     //void extractPhysicalTriangles(std::vector<PhysicalTriangle>& physicalTriangles);
     
-    void render() const;
+    void render(int lodLevel = 0) const;
+    void renderInstanced(GLint instanceMatrixLocation, GLuint instanceBuffer, size_t bufferOffset, int nInstances,
+                         int lodLevel = 0) const;
     
     MeshMarker getObligatoryMarker(std::string name);
 };
@@ -72,6 +146,14 @@ public :
     
     mat4 modelMatrix;
     
+    // never moves, may be merged into SimpleWorldContainer::staticBatches
+    bool isStatic = false;
+    // drawn from one of the static batches, set by bakeStaticBatches
+    bool inStaticBatch = false;
+    
+    // selected by SimpleWorldContainer, kept between frames for the hysteresis
+    int lodLevel = 0;
+    
     // inverse matrix is used in physics calculations
     //mat4 inverseModelMatrix;
 };
@@ -121,20 +203,105 @@ public :
     
     // two passes are required
     void processCollisionsAgainstMesh(GLPositionedMesh& mesh, CollisionPhase phase);
+    // adds the faces to DebugDraw::instance, drawn when it is flushed
     void dumpRenderCollisionsAgainstMesh(GLPositionedMesh& mesh);
     
     void applyYSmooth(ftype timeCoefficient);
 };
 
+// world space geometry of all static meshes with the same texture within one chunk
+class StaticBatch
+{
+public :
+    GLSingleTextureMesh mesh;
+    AxisAlignedBox bounds;
+    
+    // of SimpleWorldContainer::cellGraph, -1 outside of every cell
+    int cell = -1;
+    
+    int lodLevel = 0;
+};
+
 // simply provides group interface
 class SimpleWorldContainer
 {
+    // of the last cullPositionedMeshes
+    Frustum frustum;
+    BoxArrays worldBoxes;
+    std::vector<uint8_t> positionedMeshVisible;
+    
+    // set by buildCells, -1 for meshes outside of every cell
+    std::vector<int> positionedMeshCell;
+    // cellGraph visibility was computed, frustum narrowed to the portals every visible cell was seen through
+    bool portalCulling = false;
+    std::vector<Frustum> cellFrusta;
+    
+    // occlusionBuffer is filled for the current frame
+    bool occlusionCulling = false;
+    
+    // fills positionedMeshVisible, static meshes are culled too
+    void cullPositionedMeshes(mat4 projectionViewMatrix);
+    void cullOccludedMeshes(mat4 projectionViewMatrix);
+    
+    // after the opaque queue: queries meshes & draws the hidden ones conditionally
+    void renderOcclusionQueries(mat4 projectionViewMatrix, GLuint program);
+    bool isCulledByPortals(int cell, const AxisAlignedBox& worldBounds) const;
+    void addStaticBatchesToQueue(mat4 projectionViewMatrix, GLuint program);
+    
+    // nLevels is the level count of the mesh, the sphere is in world space
+    int selectLod(int currentLevel, const BoundingSphere& worldSphere, int nLevels, const mat4& projectionViewMatrix) const;
+
 public :
     std::vector<GLPositionedMesh> positionedMeshes;
     
-    void addPositionedMesh(GLSimpleMesh& baseMesh, vec3 position);
+    // triangles are assigned to cubic chunks of this size by their centroids
+    ftype staticChunkSize = 16;
+    std::vector<StaticBatch> staticBatches;
+    
+    // baked meshes are drawn from staticBatches
+    bool useStaticBatches = true;
+    // static meshes positioned with the same base mesh more than once are left out of the batches,
+    // so renderWorldInstanced draws them as instances; bakeStaticBatches must be called again after a change
+    bool instanceRepeatedMeshes = false;
+    
+    RenderQueue renderQueue;
+    
+    // every positioned mesh with portal markers is a room, other meshes belong to the room containing them
+    CellPortalGraph cellGraph;
+    bool usePortals = true;
+    
+    // occluder meshes are rasterized on the CPU when the camera is outside of every cell
+    OcclusionBuffer occlusionBuffer;
+    bool useOcclusionCulling = false;
+    
+    // renderWorld only: meshes found hidden by GPU queries are skipped until a query finds them again;
+    // while set no mesh is baked, so every one is queried, bakeStaticBatches must be called again after a change
+    OcclusionQueries occlusionQueries;
+    bool useOcclusionQueries = false;
+    // model matrices of the meshes drawn behind queries by programs with a DrawUniforms block
+    DrawUniformBuffer occlusionDrawUniforms;
+    
+    // distant meshes & static batches are drawn with their simplified levels
+    LodSelector lodSelector;
+    bool useLods = true;
+    
+    void addPositionedMesh(GLSimpleMesh& baseMesh, vec3 position, bool isStatic = false);
+    
+    // must be called again after rooms are added or moved, before bakeStaticBatches
+    void buildCells();
+    
+    // must be called again after static meshes are added or changed; meshes left out of the batches
+    // by instanceRepeatedMeshes or useOcclusionQueries are drawn one by one
+    void bakeStaticBatches();
+    
+    // opaque parts sorted by state & front to back; meshes with a texture array mesh are drawn
+    // in one call with textureArrayProgram (compiled with TEXTURE_ARRAY) unless it is 0
+    void renderWorld(mat4 projectionViewMatrix, GLuint program, GLuint textureArrayProgram = 0);
     
-    void renderWorld(mat4 projectionViewMatrix);
+    // one instanced draw per base mesh part, the programs must be compiled with INSTANCED;
+    // static batches are drawn with staticProgram
+    void renderWorldInstanced(mat4 projectionViewMatrix, GLuint instancedProgram, GLuint staticProgram,
+                              GLuint instancedTextureArrayProgram = 0);
     void processPhysics(CharacterController& controller, ftype dt);
     void dumpRenderPhysics(CharacterController& controller);
 };
@@ -9,73 +9,6 @@
 using namespace std;
 using namespace sge;
 
-void FullScreenRenderTarget::create(int width, int height)
-{
-    printf("created %d x %d\n", width, height);
-    glGenTextures(1, &textureId);
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    glGenRenderbuffers(1, &zBufferRbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, zBufferRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
-                          width, height);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, zBufferRbo);
-
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    SDL_assert(status == GL_FRAMEBUFFER_COMPLETE);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-void FullScreenRenderTarget::destroy()
-{
-    if (textureId)
-    {
-        glDeleteTextures(1, &textureId);
-        textureId = 0;
-    }
-    if (zBufferRbo)
-    {
-        glDeleteRenderbuffers(1, &zBufferRbo);
-        zBufferRbo = 0;
-    }
-    
-    if (fbo)
-    {
-        glDeleteFramebuffers(1, &fbo);
-        fbo = 0;
-    }
-}
-
-void FullScreenRenderTarget::renderScreenQuad()
-{
-    glBindTexture(GL_TEXTURE_2D, textureId);
-    glEnable(GL_TEXTURE_2D);
-    glLoadIdentity();
-    
-    glBegin(GL_QUADS);
-    glTexCoord2f(0, 0); glVertex2f(-1, -1);
-    glTexCoord2f(0, 1); glVertex2f(-1, +1);
-    glTexCoord2f(1, 1); glVertex2f(+1, +1);
-    glTexCoord2f(1, 0); glVertex2f(+1, -1);
-    glEnd();
-    
-    glBindTexture(GL_TEXTURE_2D, 0);
-}
-
 // gets 'shortest rotation' (without 'spinning')
 mat4 getRotationMatrix(vec3 from, vec3 to)
 {
@@ -92,21 +25,48 @@ mat4 getRotationMatrix(vec3 from, vec3 to)
 
 void GameController::initializeGraphics(int width, int height)
 {   
-    blurBufferA.create(width, height);
-    blurBufferB.create(width, height);
+    currentWidth = width;
+    currentHeight = height;
     
     meshCollection.loadMeshes();
         
     for (int z = 5; z >= -20; z -= 3)
     {
         for (int t = 0; t < 2; t++)
-            worldContainer.addPositionedMesh(meshCollection.cubeMesh, vec3((t * 2 - 1) * 3, 0, z));
+            worldContainer.addPositionedMesh(meshCollection.cubeMesh, vec3((t * 2 - 1) * 3, 0, z), true);
         
         //cubePositions.push_back(vec3(-3, 0, z));
         //cubePositions.push_back(vec3(3, 0, z));
     }
     
-    worldContainer.addPositionedMesh(meshCollection.plane, vec3(0, 0, 0));
+    worldContainer.addPositionedMesh(meshCollection.plane, vec3(0, 0, 0), true);
+    
+    // staircase modules behind the start, each one continues where the previous one ends;
+    // they are rooms connected by their entrance & exit portals
+    mat4 currentModelview = glm::translate(mat4(), vec3(0, 0, 5)) * glm::rotate(mat4(), M_PI, vec3(0, 1, 0));
+    vec3 viewDirection(0, 0, -5);
+    
+    for (int i = 0; i < 4; i++)
+    {
+        GLSimpleMesh& simpleMesh = meshCollection.staircase;
+        
+        GLPositionedMesh positioned;
+        positioned.baseMesh = &simpleMesh;
+        positioned.modelMatrix = currentModelview;
+        positioned.isStatic = true;
+        
+        worldContainer.positionedMeshes.push_back(positioned);
+        
+        MeshMarker continuation = simpleMesh.getObligatoryMarker("continuation-point");
+        
+        currentModelview = glm::translate(currentModelview, continuation.position);
+        currentModelview = currentModelview * getRotationMatrix(viewDirection, continuation.direction);
+    }
+    
+    // static batches are split by cell, so the cells come first
+    worldContainer.buildCells();
+    worldContainer.instanceRepeatedMeshes = instancedWorld;
+    worldContainer.bakeStaticBatches();
     
     //loadColladaMeshNew("resources/dae-inspection.dae");
     //newMesh = loadColladaMeshNew("resources/hyena-decimated.dae");
@@ -117,6 +77,16 @@ void GameController::initializeGraphics(int width, int height)
     newMesh = loadColladaMeshNew("resources/astroboy.dae");
     //for (int i = 0; i < 10; i++)
     
+    crowdAnimation.bake(newMesh, 30.0);
+    gpuSkinnedMesh.upload(newMesh);
+    
+    for (int x = -8; x < 8; x++)
+        for (int z = 0; z < 16; z++)
+        {
+            ftype timeShift = ((x * 7 + z * 13) % 17 + 17) % 17 * 0.13;
+            crowdInstances.push_back(vec4(x * 1.5, 0, -8 - z * 1.5, timeShift));
+        }
+    
     //loadedMesh = loadColladaMesh("resources/Hyena_Rig_Final.dae");
     
     /*int x = -1;
@@ -149,27 +119,6 @@ void GameController::initializeGraphics(int width, int height)
     //static GLSimpleMesh stairs = meshCollection.createStaircase(0.27, 0, 0, 0.27, 10);
     //worldContainer.addPositionedMesh(stairs, vec3(0, 0, -1));
     
-    mat4 currentModelview;
-    vec3 viewDirection(0, 0, -5);
-    
-#if 0
-    for (int i = 0; i < 2; i++)
-    {
-        GLSimpleMesh& simpleMesh = meshCollection.staircase;
-        
-        GLPositionedMesh positioned;
-        positioned.baseMesh = &simpleMesh;
-        positioned.modelMatrix = currentModelview;
-        
-        worldContainer.positionedMeshes.push_back(positioned);
-        
-        MeshMarker continuation = simpleMesh.getObligatoryMarker("continuation-point");
-        
-        currentModelview = glm::translate(currentModelview, continuation.position);
-        currentModelview = currentModelview * getRotationMatrix(viewDirection, continuation.direction);
-    }
-#endif
-
     currentWidth = width;
     currentHeight = height;
     
@@ -198,41 +147,107 @@ void GameController::initializeGraphics(int width, int height)
 
 void GameController::reloadShaders()
 {
-    if (vertexShader)
-    {
-        glDeleteShader(vertexShader);
-        vertexShader = 0;
-    }
+    glUseProgram(0);
+    
+    for (GLuint* program: { &shaderProgram, &crowdShaderProgram, &skinningShaderProgram, &instancedShaderProgram,
+                            &textureArrayShaderProgram, &instancedTextureArrayShaderProgram, &coreShaderProgram,
+                            &coreInstancedShaderProgram, &coreTextureArrayShaderProgram,
+                            &coreInstancedTextureArrayShaderProgram, &wireframeShaderProgram,
+                            &instancedWireframeShaderProgram, &coloredWireframeShaderProgram, &postCopyShaderProgram,
+                            &downsampleShaderProgram, &gaussianBlurShaderProgram, &motionBlurCompositeShaderProgram })
+        if (*program)
+        {
+            glDeleteProgram(*program);
+            *program = 0;
+        }
     
-    if (fragmentShader)
+    string defineString = "";
+    for (auto& it: shaderDefines)
+        defineString += "#define " + it + "\n";
+    
+    shaderProgram = createGlProgram("resources/vertex-shader.glsl", "resources/fragment-shader.glsl", defineString.c_str());
+    crowdShaderProgram = createGlProgram("resources/vat-vertex-shader.glsl", "resources/vat-fragment-shader.glsl",
+                                         defineString.c_str(), { "vertexIndex" });
+    // the instance matrix is bound to INSTANCE_MATRIX_ATTRIBUTE, away from the mesh attributes
+    instancedShaderProgram = createGlProgram("resources/vertex-shader.glsl", "resources/fragment-shader.glsl",
+                                             (defineString + "#define INSTANCED\n").c_str(), getVertexAttributeNames());
+    textureArrayShaderProgram = createGlProgram("resources/vertex-shader.glsl", "resources/fragment-shader.glsl",
+                                                (defineString + "#define TEXTURE_ARRAY\n").c_str());
+    instancedTextureArrayShaderProgram =
+        createGlProgram("resources/vertex-shader.glsl", "resources/fragment-shader.glsl",
+                        (defineString + "#define INSTANCED\n#define TEXTURE_ARRAY\n").c_str(), getVertexAttributeNames());
+    
+    auto createCoreProgram = [&](string variantDefines)
     {
-        glDeleteShader(fragmentShader);
-        fragmentShader = 0;
-    }
+        GLuint program = createGlProgram("resources/core-vertex-shader.glsl", "resources/core-fragment-shader.glsl",
+                                         (defineString + variantDefines).c_str(), getVertexAttributeNames());
+        bindUniformBlocks(program);
+        return program;
+    };
+    
+    coreShaderProgram = createCoreProgram("");
+    coreInstancedShaderProgram = createCoreProgram("#define INSTANCED\n");
+    coreTextureArrayShaderProgram = createCoreProgram("#define TEXTURE_ARRAY\n");
+    coreInstancedTextureArrayShaderProgram = createCoreProgram("#define INSTANCED\n#define TEXTURE_ARRAY\n");
+    
+    // geometry shaders need GLSL 1.50, the compatibility profile keeps the fixed-function inputs of the other stages
+    auto createWireframeProgram = [&](string variantDefines)
+    {
+        string prefix = "#version 150 compatibility\n" + defineString + variantDefines + "#define WIREFRAME\n";
+        return createGlProgramWithGeometryShader("resources/vertex-shader.glsl", "resources/wireframe-geometry-shader.glsl",
+                                                 "resources/fragment-shader.glsl", prefix.c_str(),
+                                                 getVertexAttributeNames());
+    };
     
-    if (shaderProgram)
+    wireframeShaderProgram = createWireframeProgram("");
+    instancedWireframeShaderProgram = createWireframeProgram("#define INSTANCED\n");
+    
+    // the skinned mesh is always drawn with its wireframe, thicker than the world one
+    skinningShaderProgram = createWireframeProgram("#define SKINNING\n");
+    coloredWireframeShaderProgram = createWireframeProgram("#define COLORED\n");
+    
+    for (GLuint program: { skinningShaderProgram, coloredWireframeShaderProgram })
     {
-        glUseProgram(0);
-        glDeleteProgram(shaderProgram);
-        shaderProgram = 0;
+        glUseProgram(program);
+        glUniform1f(glGetUniformLocation(program, "wireframeWidth"), 2);
     }
     
-    string defineString = "";
-    for (auto& it: shaderDefines)
-        defineString += "#define " + it + "\n";
+    // without the defines of the world, they never change the scene itself
+    auto createPostProgram = [&](string variantDefines)
+    {
+        return createGlProgram("resources/post-vertex-shader.glsl", "resources/post-fragment-shader.glsl",
+                               variantDefines.c_str());
+    };
     
-    vertexShader = loadGlShader("resources/vertex-shader.glsl", GL_VERTEX_SHADER, defineString.c_str());
-    fragmentShader = loadGlShader("resources/fragment-shader.glsl", GL_FRAGMENT_SHADER, defineString.c_str());
+    postCopyShaderProgram = createPostProgram("");
+    downsampleShaderProgram = createPostProgram("#define DOWNSAMPLE\n");
+    gaussianBlurShaderProgram = createPostProgram("#define GAUSSIAN\n");
+    motionBlurCompositeShaderProgram = createPostProgram("#define COMPOSITE\n");
     
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
+    glUseProgram(motionBlurCompositeShaderProgram);
+    glUniform1i(glGetUniformLocation(motionBlurCompositeShaderProgram, "historyTexture"), 1);
     
-    GLint linkOk;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &linkOk);
-    if (!linkOk)
-        critical_error("Failed to link shader program: %s", getShaderOrProgramLog(shaderProgram).c_str());
+    glUseProgram(0);
+}
+
+void GameController::renderGpuSkinnedMesh(mat4 projectionViewModelMatrix)
+{
+    // the only per-frame CPU work: animation sampling & joint matrices
+    newMesh.applyAnimation();
+    newMesh.updateJointMatrices();
+    gpuSkinnedMesh.updatePalette(newMesh);
+    
+    const AxisAlignedBox& bounds = newMesh.animationBounds;
+    ftype projectedSize = getProjectedSize(projectionViewModelMatrix,
+                                           BoundingSphere(bounds.getCenter(), glm::length(bounds.getHalfExtent())));
+    
+    heroLodLevel = worldContainer.useLods ?
+                   worldContainer.lodSelector.select(heroLodLevel, projectedSize, newMesh.getLodCount()) : 0;
+    
+    // same look as Mesh::slowRender: solid with the wireframe overlay of the program
+    glColor3d(1, 1, 1);
+    gpuSkinnedMesh.render(skinningShaderProgram, heroLodLevel);
+    glUseProgram(0);
 }
 
 void GameController::updatePlayerDirection()
@@ -244,14 +259,9 @@ void GameController::changeWindowSize(int newWidth, int newHeight)
 {
 	glViewport(0, 0, newWidth, newHeight);
     
+    // targets of the new size are created by the next frame which needs them
     currentWidth = newWidth;
     currentHeight = newHeight;
-    
-    blurBufferA.destroy();
-    blurBufferB.destroy();
-    
-    blurBufferA.create(newWidth, newHeight);
-    blurBufferB.create(newWidth, newHeight);
 }
 
 void GameController::simulateWorld(ftype msPassed)
@@ -307,9 +317,6 @@ void GameController::keyReleased(SDL_Keycode keycode)
     if (keycode == SDLK_o)
     {
         wireframeMode = !wireframeMode;
-        
-        if (wireframeMode)
-            enableSimpleBlur = false;
     }
     
     if (keycode == SDLK_p)
@@ -340,18 +347,85 @@ void GameController::keyReleased(SDL_Keycode keycode)
         player.ySmooth = player.position.y;
     }
     
+    if (keycode == SDLK_z)
+    {
+        qualityGovernor.enabled = !qualityGovernor.enabled;
+        qualityGovernor.reset();
+    }
+    
     if (keycode == SDLK_b)
     {
-        enableSimpleBlur = !enableSimpleBlur;
-        
-        if (enableSimpleBlur)
-            wireframeMode = false;
+        blurMode = blurMode == BlurMode::NONE ? BlurMode::GAUSSIAN :
+                   blurMode == BlurMode::GAUSSIAN ? BlurMode::MOTION : BlurMode::NONE;
     }
     
     if (keycode == SDLK_g)
     {
         newMesh.renderSkeleton = !newMesh.renderSkeleton;
     }
+    
+    if (keycode == SDLK_c)
+    {
+        crowdMode = !crowdMode;
+    }
+    
+    if (keycode == SDLK_k)
+    {
+        gpuSkinning = !gpuSkinning;
+    }
+    
+    if (keycode == SDLK_m)
+    {
+        newMesh.setAnimationPaused(!newMesh.animationPaused);
+    }
+    
+    if (keycode == SDLK_e)
+    {
+        instancedWorld = !instancedWorld;
+        
+        // repeated meshes go back into the batches for the single draws, or out of them to be instanced
+        worldContainer.instanceRepeatedMeshes = instancedWorld;
+        worldContainer.bakeStaticBatches();
+    }
+    
+    if (keycode == SDLK_l)
+    {
+        worldContainer.useStaticBatches = !worldContainer.useStaticBatches;
+    }
+    
+    if (keycode == SDLK_v)
+    {
+        worldContainer.usePortals = !worldContainer.usePortals;
+    }
+    
+    if (keycode == SDLK_u)
+    {
+        worldContainer.useOcclusionCulling = !worldContainer.useOcclusionCulling;
+    }
+    
+    if (keycode == SDLK_n)
+    {
+        worldContainer.useOcclusionQueries = !worldContainer.useOcclusionQueries;
+        
+        // queried meshes are drawn one by one
+        worldContainer.bakeStaticBatches();
+    }
+    
+    if (keycode == SDLK_h)
+    {
+        worldContainer.useLods = !worldContainer.useLods;
+        crowdAnimation.useLods = worldContainer.useLods;
+    }
+    
+    if (keycode == SDLK_t)
+    {
+        textureArrays = !textureArrays;
+    }
+    
+    if (keycode == SDLK_x)
+    {
+        coreRenderer = !coreRenderer;
+    }
 }
 
 void GameController::relativeMouseMotion(int dx, int dy)
@@ -375,8 +449,156 @@ void GameController::relativeMouseMotion(int dx, int dy)
     }
 }
 
+// draws the source over the bound target with one of the post programs
+static void renderPostQuad(GLuint program, FullScreenRenderTarget& source)
+{
+    glUseProgram(program);
+    glUniform2f(glGetUniformLocation(program, "texelSize"),
+                1.0f / (float)source.description.width, 1.0f / (float)source.description.height);
+    
+    glDisable(GL_DEPTH_TEST);
+    source.renderScreenQuad();
+}
+
 void GameController::renderFrame()
 {   
+    // per-frame vertex data of the frame which used this part of the buffer must have been drawn
+    StreamingBuffer::instance().beginFrame();
+    renderTargets.beginFrame();
+    qualityGovernor.beginFrame();
+    
+    QualitySettings quality = qualityGovernor.getSettings();
+    worldContainer.lodSelector.sizeScale = quality.lodSizeScale;
+    crowdAnimation.lodSelector.sizeScale = quality.lodSizeScale;
+    
+    BlurMode currentBlurMode = quality.optionalEffects ? blurMode : BlurMode::NONE;
+    
+    RenderGraph graph(renderTargets);
+    
+    RenderTargetDescription screenDescription(currentWidth, currentHeight);
+    int screen = graph.importTarget("screen", nullptr, screenDescription);
+    
+    // the aspect ratio stays that of the window, so the projection is the same
+    RenderTargetDescription sceneDescription(max((int)(currentWidth * quality.renderScale + 0.5), 1),
+                                             max((int)(currentHeight * quality.renderScale + 0.5), 1));
+    
+    if (currentBlurMode == BlurMode::NONE && sceneDescription == screenDescription)
+        graph.addPass("scene", {}, { screen }, [this](RenderGraph&) { renderScene(); });
+    else
+    {
+        int scene = graph.createTarget("scene", sceneDescription);
+        graph.addPass("scene", {}, { scene }, [this](RenderGraph&) { renderScene(); });
+        
+        // the blur passes upscale the scene themselves
+        if (currentBlurMode == BlurMode::GAUSSIAN)
+            addGaussianBlurPasses(graph, scene, screen);
+        else if (currentBlurMode == BlurMode::MOTION)
+            addMotionBlurPasses(graph, scene, screen);
+        else
+        {
+            graph.addPass("upscale", { scene }, { screen }, [this, scene](RenderGraph& graph)
+            {
+                renderPostQuad(postCopyShaderProgram, graph.getTarget(scene));
+            });
+        }
+    }
+    
+    graph.execute();
+    
+    qualityGovernor.endFrame();
+    StreamingBuffer::instance().endFrame();
+}
+
+static RenderTargetDescription getPostTargetDescription(int width, int height, int divisor)
+{
+    return RenderTargetDescription(max(width / divisor, 1), max(height / divisor, 1), GL_RGBA8, false);
+}
+
+void GameController::addGaussianBlurPasses(RenderGraph& graph, int scene, int screen)
+{
+    RenderTargetDescription half = getPostTargetDescription(currentWidth, currentHeight, 2);
+    RenderTargetDescription quarter = getPostTargetDescription(currentWidth, currentHeight, 4);
+    
+    int halfScene = graph.createTarget("half scene", half);
+    int quarterScene = graph.createTarget("quarter scene", quarter);
+    int horizontallyBlurred = graph.createTarget("horizontally blurred", quarter);
+    // gets the memory of quarterScene, which is no longer needed by then
+    int blurred = graph.createTarget("blurred", quarter);
+    
+    graph.addPass("downsample to half", { scene }, { halfScene }, [this, scene](RenderGraph& graph)
+    {
+        renderPostQuad(downsampleShaderProgram, graph.getTarget(scene));
+    });
+    
+    graph.addPass("downsample to quarter", { halfScene }, { quarterScene }, [this, halfScene](RenderGraph& graph)
+    {
+        renderPostQuad(downsampleShaderProgram, graph.getTarget(halfScene));
+    });
+    
+    auto addBlurPass = [&](string name, int source, int destination, vec2 direction)
+    {
+        graph.addPass(name, { source }, { destination }, [this, source, direction](RenderGraph& graph)
+        {
+            glUseProgram(gaussianBlurShaderProgram);
+            glUniform2f(glGetUniformLocation(gaussianBlurShaderProgram, "blurDirection"),
+                        (float)direction.x, (float)direction.y);
+            
+            renderPostQuad(gaussianBlurShaderProgram, graph.getTarget(source));
+        });
+    };
+    
+    addBlurPass("horizontal blur", quarterScene, horizontallyBlurred, vec2(1, 0));
+    addBlurPass("vertical blur", horizontallyBlurred, blurred, vec2(0, 1));
+    
+    // bilinear filtering is enough to upsample what has been blurred
+    graph.addPass("upsample", { blurred }, { screen }, [this, blurred](RenderGraph& graph)
+    {
+        renderPostQuad(postCopyShaderProgram, graph.getTarget(blurred));
+    });
+}
+
+void GameController::addMotionBlurPasses(RenderGraph& graph, int scene, int screen)
+{
+    // at the window resolution, so a still picture settles to the sharp scene; color only, nothing is depth tested
+    RenderTargetDescription historyDescription = getPostTargetDescription(currentWidth, currentHeight, 1);
+    bool historyLost = blurHistory.ensure(historyDescription);
+    
+    int history = graph.importTarget("blur history", &blurHistory, historyDescription);
+    
+    // the same weights as blending the scene into the history, which was shown
+    const float sceneWeight = 0.15f;
+    float weight = historyLost ? 1.0f : sceneWeight;
+    
+    graph.addPass("motion blur composite", { scene, history }, { screen }, [this, scene, history, weight](RenderGraph& graph)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, graph.getTarget(history).textureId);
+        glActiveTexture(GL_TEXTURE0);
+        
+        glUseProgram(motionBlurCompositeShaderProgram);
+        glUniform1f(glGetUniformLocation(motionBlurCompositeShaderProgram, "sceneWeight"), weight);
+        renderPostQuad(motionBlurCompositeShaderProgram, graph.getTarget(scene));
+        
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    });
+    
+    // after the composite has read the previous history
+    graph.addPass("motion blur accumulation", { scene }, { history }, [this, scene, weight](RenderGraph& graph)
+    {
+        glEnable(GL_BLEND);
+        glBlendColor(0, 0, 0, weight);
+        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+        
+        renderPostQuad(postCopyShaderProgram, graph.getTarget(scene));
+        
+        glDisable(GL_BLEND);
+    });
+}
+
+void GameController::renderScene()
+{
     ftype angle = currentTime / 5.0;
     
     projectionMatrix = mat4();
@@ -407,19 +629,6 @@ void GameController::renderFrame()
     modelMatrix = glm::rotate(modelMatrix, angle, vec3(sin(angle), sin(angle + 2 * M_PI / 3), sin(angle + M_PI / 3)));
     modelMatrix = glm::scale(modelMatrix, vec3(2, 2, 2));
     
-    if (wireframeMode)
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-    else
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    
-    // glPolygonMode does not work in framebuffers,
-    // so we should not use them unless the blur is enabled,
-    // or the wireframe mode won't work
-    SDL_assert(!(wireframeMode && enableSimpleBlur));
-    
-    if (enableSimpleBlur)
-        glBindFramebuffer(GL_FRAMEBUFFER, blurBufferA.fbo);
-    
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glEnable(GL_DEPTH_TEST);
     
@@ -427,9 +636,41 @@ void GameController::renderFrame()
     //glEnable(GL_TEXTURE_2D);
 	//glBindTexture(GL_TEXTURE_2D, texture.openglId);
     
-    glUseProgram(shaderProgram);
+    frameUniforms.update(projectionMatrix, viewMatrix);
+    
+    if (instancedWorld)
+    {
+        GLuint instancedProgram = coreRenderer ? coreInstancedShaderProgram : instancedShaderProgram;
+        GLuint staticProgram = coreRenderer ? coreShaderProgram : shaderProgram;
+        GLuint textureArrayProgram = coreRenderer ? coreInstancedTextureArrayShaderProgram
+                                                  : instancedTextureArrayShaderProgram;
+        
+        // the wireframe has legacy programs only, without texture arrays
+        if (wireframeMode)
+        {
+            instancedProgram = instancedWireframeShaderProgram;
+            staticProgram = wireframeShaderProgram;
+            textureArrayProgram = 0;
+        }
+        
+        worldContainer.renderWorldInstanced(projectionMatrix * viewMatrix, instancedProgram, staticProgram,
+                                            textureArrays ? textureArrayProgram : 0);
+    }
+    else
+    {
+        GLuint program = coreRenderer ? coreShaderProgram : shaderProgram;
+        GLuint textureArrayProgram = coreRenderer ? coreTextureArrayShaderProgram : textureArrayShaderProgram;
+        
+        if (wireframeMode)
+        {
+            program = wireframeShaderProgram;
+            textureArrayProgram = 0;
+        }
+        
+        worldContainer.renderWorld(projectionMatrix * viewMatrix, program, textureArrays ? textureArrayProgram : 0);
+    }
     
-    worldContainer.renderWorld(projectionMatrix * viewMatrix);
+    glUseProgram(shaderProgram);
     
     mat4 finalMatrix = projectionMatrix * viewMatrix;
     glLoadMatrixd(glm::value_ptr(finalMatrix));
@@ -457,36 +698,42 @@ void GameController::renderFrame()
         
         finalMatrix = projectionMatrix * viewMatrix * modelMatrix;
         glLoadMatrixd(glm::value_ptr(finalMatrix));
-        newMesh.slowRender();
         
-        glUseProgram(shaderProgram);
+        // outside the frustum over the whole animation: no sampling, no skinning;
+        // otherwise only the pose is kept up to date while it is outside
+        if (!newMesh.animationBounds.isOutsideClipVolume(finalMatrix))
+        {
+            if (newMesh.getPoseBounds().isOutsideClipVolume(finalMatrix))
+                newMesh.updatePose();
+            else if (gpuSkinning)
+                renderGpuSkinnedMesh(finalMatrix);
+            else
+            {
+                // the skeleton is added in model space
+                DebugDraw::instance().transform = modelMatrix;
+                newMesh.slowRender(coloredWireframeShaderProgram);
+                DebugDraw::instance().transform = mat4();
+            }
+        }
+        
+        if (crowdMode)
+        {
+            modelMatrix = glm::mat4();
+            modelMatrix = glm::scale(modelMatrix, vec3(sc, sc, -sc));
+            modelMatrix = modelMatrix * axisSwap;
+            
+            glColor3d(0.8, 0.8, 0.8);
+            crowdAnimation.renderInstances(crowdShaderProgram, projectionMatrix * viewMatrix, modelMatrix,
+                                           crowdInstances, currentTime);
+            glColor3d(1, 1, 1);
+        }
+        
+        glUseProgram(wireframeMode ? wireframeShaderProgram : shaderProgram);
     }
 
     if (physicsDebugMode)
-    {
-        modelMatrix = mat4();
-        modelMatrix = glm::translate(modelMatrix, player.position);
-        modelMatrix = glm::scale(modelMatrix, vec3(player.radius, player.radius, player.radius));
-        
-        glLoadMatrixd(glm::value_ptr(projectionMatrix * viewMatrix * modelMatrix));
-        meshCollection.cubeMesh.render();
-    }
+        DebugDraw::instance().addSphere(BoundingSphere(player.position, player.radius), vec4(0, 1, 0, 1));
     
-    if (enableSimpleBlur)
-    {
-        glDisable(GL_DEPTH_TEST);
-    
-        glEnable(GL_BLEND);
-        glBlendColor(0, 0, 0, 0.85f);
-        glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
-        
-        blurBufferB.renderScreenQuad();
-        
-        glDisable(GL_BLEND);
-        
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        blurBufferA.renderScreenQuad();
-        
-        swap(blurBufferA, blurBufferB);
-    }
+    DebugDraw::instance().flush(projectionMatrix * viewMatrix);
+    glUseProgram(wireframeMode ? wireframeShaderProgram : shaderProgram);
 }
@@ -7,23 +7,26 @@
 #include "ScpMeshCollection.h"
 #include "ShaderUtils.h"
 #include "ColladaMeshLoader.h"
+#include "VertexAnimationTexture.h"
+#include "GpuSkinning.h"
+#include "UniformBuffers.h"
+#include "StreamingBuffer.h"
+#include "DebugDraw.h"
+#include "RenderGraph.h"
+#include "QualityGovernor.h"
 
 #include <set>
 
 namespace sge
 {
 
-class FullScreenRenderTarget
+enum class BlurMode
 {
-public :
-    GLuint textureId = 0;
-    GLuint zBufferRbo = 0;
-    GLuint fbo = 0;
-    
-    void create(int width, int height);
-    void destroy();
-    
-    void renderScreenQuad();
+    NONE,
+    // downsampled to a quarter of the resolution & blurred there
+    GAUSSIAN,
+    // every frame is mixed with the blurred frames before it
+    MOTION
 };
 
 class GameController : public IGameController
@@ -39,7 +42,12 @@ class GameController : public IGameController
     bool wireframeMode = false;
     bool fogEnabled = false;
     bool physicsDebugMode = true;
-    bool enableSimpleBlur = false;
+    BlurMode blurMode = BlurMode::NONE;
+    bool crowdMode = false;
+    bool gpuSkinning = false;
+    bool instancedWorld = true;
+    bool textureArrays = true;
+    bool coreRenderer = true;
     
     CharacterController player;
     vec3 cameraVector;
@@ -57,13 +65,60 @@ class GameController : public IGameController
     
     sge::Mesh newMesh;
     
-    GLuint vertexShader = 0, fragmentShader = 0;
+    // background extras, played back from a texture baked from newMesh
+    VertexAnimationTexture crowdAnimation;
+    std::vector<vec4> crowdInstances;
+    
+    GpuSkinnedMesh gpuSkinnedMesh;
+    int heroLodLevel = 0;
+    
     GLuint shaderProgram = 0;
+    GLuint crowdShaderProgram = 0;
+    GLuint skinningShaderProgram = 0;
+    GLuint instancedShaderProgram = 0;
+    GLuint textureArrayShaderProgram = 0;
+    GLuint instancedTextureArrayShaderProgram = 0;
+    
+    // the world programs above built from core-vertex-shader.glsl: float uniform blocks, no fixed-function matrices
+    GLuint coreShaderProgram = 0;
+    GLuint coreInstancedShaderProgram = 0;
+    GLuint coreTextureArrayShaderProgram = 0;
+    GLuint coreInstancedTextureArrayShaderProgram = 0;
+    
+    // vertex-shader.glsl with wireframe-geometry-shader.glsl: solid & wireframe in one pass;
+    // skinningShaderProgram is one of them too
+    GLuint wireframeShaderProgram = 0;
+    GLuint instancedWireframeShaderProgram = 0;
+    GLuint coloredWireframeShaderProgram = 0;
     
-    FullScreenRenderTarget blurBufferA, blurBufferB;
+    // post-fragment-shader.glsl variants
+    GLuint postCopyShaderProgram = 0;
+    GLuint downsampleShaderProgram = 0;
+    GLuint gaussianBlurShaderProgram = 0;
+    GLuint motionBlurCompositeShaderProgram = 0;
+    
+    FrameUniformBuffer frameUniforms;
+    
+    RenderTargetPool renderTargets;
+    
+    // render scale, LOD size scale & whether the blur is allowed, adjusted to keep the frame time
+    QualityGovernor qualityGovernor;
+    
+    // the motion blurred frames so far at the window resolution, kept between frames unlike the targets of the render graph
+    FullScreenRenderTarget blurHistory;
     
     void reloadShaders();
     
+    // everything except post effects, into the bound framebuffer
+    void renderScene();
+    
+    // passes from scene to screen
+    void addGaussianBlurPasses(RenderGraph& graph, int scene, int screen);
+    void addMotionBlurPasses(RenderGraph& graph, int scene, int screen);
+    
+    // the level of detail is picked with the thresholds of the world container
+    void renderGpuSkinnedMesh(mat4 projectionViewModelMatrix);
+    
     void updatePlayerDirection();
     
 public :
@@ -0,0 +1,134 @@
+#include "GpuSkinning.h"
+
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+using namespace sge;
+
+struct GpuSkinnedVertex
+{
+    float position[3];
+    GLubyte jointIndices[MAX_PACKED_INFLUENCES];
+    float jointWeights[MAX_PACKED_INFLUENCES];
+};
+
+void GpuSkinnedMesh::upload(Mesh& mesh)
+{
+    destroy();
+    
+    nJoints = (int)mesh.joints.size();
+    verify(nJoints <= GPU_SKINNING_MAX_JOINTS, "GPU skinning supports up to %d joints, mesh has %d.",
+           GPU_SKINNING_MAX_JOINTS, nJoints);
+    
+    mesh.applyBindShapeMatrix();
+    
+    vector<GpuSkinnedVertex> vertices(mesh.vertices.size());
+    
+    for (int i = 0; i < (int)vertices.size(); i++)
+    {
+        GpuSkinnedVertex& vertex = vertices[i];
+        const vec3& position = mesh.vertices[i].position;
+        
+        vertex.position[0] = (float)position.x;
+        vertex.position[1] = (float)position.y;
+        vertex.position[2] = (float)position.z;
+        
+        int jointIndices[MAX_PACKED_INFLUENCES];
+        ftype weights[MAX_PACKED_INFLUENCES];
+        mesh.getPackedInfluences(i, jointIndices, weights);
+        
+        for (int j = 0; j < MAX_PACKED_INFLUENCES; j++)
+        {
+            vertex.jointIndices[j] = (GLubyte)jointIndices[j];
+            vertex.jointWeights[j] = (float)weights[j];
+        }
+    }
+    
+    vector<GLuint> indices;
+    lodRanges = LodIndexRanges();
+    
+    for (int level = 0; level < mesh.getLodCount(); level++)
+        lodRanges.addLevel(indices, mesh.getLodIndices(level));
+    
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GpuSkinnedVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    glGenBuffers(1, &elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    
+    // the whole block is allocated, std140 mat4 arrays are tightly packed column-major floats
+    glGenBuffers(1, &paletteBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, paletteBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, GPU_SKINNING_MAX_JOINTS * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void GpuSkinnedMesh::destroy()
+{
+    for (GLuint* buffer: { &vertexBuffer, &elementBuffer, &paletteBuffer })
+        if (*buffer)
+        {
+            glDeleteBuffers(1, buffer);
+            *buffer = 0;
+        }
+}
+
+void GpuSkinnedMesh::updatePalette(const Mesh& mesh)
+{
+    SDL_assert((int)mesh.joints.size() == nJoints);
+    
+    vector<glm::mat4> palette(nJoints);
+    for (int i = 0; i < nJoints; i++)
+        palette[i] = glm::mat4(mesh.joints[i].transformationMatrix);
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, paletteBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, palette.size() * sizeof(glm::mat4), palette.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void GpuSkinnedMesh::render(GLuint program, int lodLevel)
+{
+    SDL_assert(vertexBuffer);
+    
+    glUseProgram(program);
+    
+    GLuint paletteBlock = glGetUniformBlockIndex(program, "JointPalette");
+    verify(paletteBlock != GL_INVALID_INDEX, "Skinning program has no 'JointPalette' uniform block.");
+    glUniformBlockBinding(program, paletteBlock, JOINT_PALETTE_BINDING);
+    glBindBufferBase(GL_UNIFORM_BUFFER, JOINT_PALETTE_BINDING, paletteBuffer);
+    
+    GLint jointIndicesLocation = glGetAttribLocation(program, "jointIndices");
+    GLint jointWeightsLocation = glGetAttribLocation(program, "jointWeights");
+    verify(jointIndicesLocation >= 0 && jointWeightsLocation >= 0,
+           "Skinning program must use 'jointIndices' and 'jointWeights' attributes.");
+    
+    GLsizei stride = sizeof(GpuSkinnedVertex);
+    
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, (const GLvoid*)offsetof(GpuSkinnedVertex, position));
+    
+    glEnableVertexAttribArray(jointIndicesLocation);
+    glVertexAttribPointer(jointIndicesLocation, MAX_PACKED_INFLUENCES, GL_UNSIGNED_BYTE, GL_FALSE, stride,
+                          (const GLvoid*)offsetof(GpuSkinnedVertex, jointIndices));
+    
+    glEnableVertexAttribArray(jointWeightsLocation);
+    glVertexAttribPointer(jointWeightsLocation, MAX_PACKED_INFLUENCES, GL_FLOAT, GL_FALSE, stride,
+                          (const GLvoid*)offsetof(GpuSkinnedVertex, jointWeights));
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glDrawElements(GL_TRIANGLES, lodRanges.getIndexCount(lodLevel), GL_UNSIGNED_INT, lodRanges.getIndexOffset(lodLevel));
+    
+    glDisableVertexAttribArray(jointWeightsLocation);
+    glDisableVertexAttribArray(jointIndicesLocation);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,43 @@
+#ifndef SGE_GPU_SKINNING_H
+#define SGE_GPU_SKINNING_H
+
+#include "Common.h"
+#include "ColladaMeshLoader.h"
+
+namespace sge
+{
+
+// must match MAX_JOINTS in vertex-shader.glsl
+const int GPU_SKINNING_MAX_JOINTS = 128;
+
+// uniform buffer binding point of the JointPalette block
+const GLuint JOINT_PALETTE_BINDING = 0;
+
+// Skinning in the vertex shader (vertex-shader.glsl compiled with SKINNING):
+// bind pose positions with MAX_PACKED_INFLUENCES joint indices & weights are uploaded once,
+// per frame only the joint palette (transformationMatrix of every joint) is sent as a uniform block.
+class GpuSkinnedMesh
+{
+public :
+    // interleaved GpuSkinnedVertex entries
+    GLuint vertexBuffer = 0;
+    GLuint elementBuffer = 0;
+    GLuint paletteBuffer = 0;
+    
+    // one range per level of detail of the mesh
+    LodIndexRanges lodRanges;
+    int nJoints = 0;
+    
+    void upload(Mesh& mesh);
+    void destroy();
+    
+    // joint matrices must be up to date, see Mesh::updateJointMatrices
+    void updatePalette(const Mesh& mesh);
+    
+    // uses the current modelview & projection matrices
+    void render(GLuint program, int lodLevel = 0);
+};
+
+}
+
+#endif // SGE_GPU_SKINNING_H
@@ -0,0 +1,375 @@
+#include "MeshLod.h"
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+// border planes weigh this much more than the surface, per squared edge length
+const ftype BORDER_PLANE_WEIGHT = 10;
+
+// a level is dropped when it keeps more of the previous level's triangles
+const ftype LOD_MIN_REDUCTION = 0.9;
+
+// collapses turning a triangle normal by more than acos of this are rejected, so nothing folds over
+const ftype MIN_NORMAL_COSINE = 0.25;
+
+// sum of weighted squared distances to planes, as the symmetric 4x4 matrix of the plane outer products
+class Quadric
+{
+public :
+    ftype a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+    ftype a11 = 0, a12 = 0, a13 = 0;
+    ftype a22 = 0, a23 = 0;
+    ftype a33 = 0;
+    
+    ftype weight = 0;
+    
+    // normal must be unit, points p with dot(normal, p) + distance == 0 are on the plane
+    void addPlane(vec3 normal, ftype distance, ftype planeWeight)
+    {
+        a00 += planeWeight * normal.x * normal.x;
+        a01 += planeWeight * normal.x * normal.y;
+        a02 += planeWeight * normal.x * normal.z;
+        a03 += planeWeight * normal.x * distance;
+        a11 += planeWeight * normal.y * normal.y;
+        a12 += planeWeight * normal.y * normal.z;
+        a13 += planeWeight * normal.y * distance;
+        a22 += planeWeight * normal.z * normal.z;
+        a23 += planeWeight * normal.z * distance;
+        a33 += planeWeight * distance * distance;
+        
+        weight += planeWeight;
+    }
+    
+    void add(const Quadric& other)
+    {
+        a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+        a11 += other.a11; a12 += other.a12; a13 += other.a13;
+        a22 += other.a22; a23 += other.a23;
+        a33 += other.a33;
+        
+        weight += other.weight;
+    }
+    
+    // weighted mean of the squared distances
+    ftype evaluate(vec3 p) const
+    {
+        if (weight <= 0)
+            return 0;
+        
+        ftype sum = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z + a33
+                    + 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z + a03 * p.x + a13 * p.y + a23 * p.z);
+        
+        return max(sum, (ftype)0) / weight;
+    }
+};
+
+class EdgeCollapse
+{
+public :
+    int from, to;
+    // squared
+    ftype error;
+};
+
+static vec3 getTriangleNormal(const vector<vec3>& positions, const int* triangle)
+{
+    return glm::cross(positions[triangle[1]] - positions[triangle[0]], positions[triangle[2]] - positions[triangle[0]]);
+}
+
+static void computeQuadrics(const vector<vec3>& positions, const vector<int>& indices, vector<Quadric>& quadrics)
+{
+    quadrics.assign(positions.size(), Quadric());
+    
+    // (smaller, larger) vertex -> use count & the last triangle
+    map<pair<int, int>, pair<int, int>> edges;
+    
+    for (int t = 0; t * 3 < (int)indices.size(); t++)
+    {
+        const int* triangle = &indices[t * 3];
+        
+        vec3 normal = getTriangleNormal(positions, triangle);
+        ftype doubleArea = glm::length(normal);
+        
+        if (doubleArea < 1e-12)
+            continue;
+        
+        normal = normal / doubleArea;
+        ftype distance = -glm::dot(normal, positions[triangle[0]]);
+        
+        for (int corner = 0; corner < 3; corner++)
+        {
+            quadrics[triangle[corner]].addPlane(normal, distance, doubleArea * 0.5);
+            
+            int a = triangle[corner], b = triangle[(corner + 1) % 3];
+            pair<int, int>& uses = edges[make_pair(min(a, b), max(a, b))];
+            uses.first++;
+            uses.second = t;
+        }
+    }
+    
+    for (auto& edge: edges)
+    {
+        if (edge.second.first != 1)
+            continue;
+        
+        const int* triangle = &indices[edge.second.second * 3];
+        vec3 normal = getTriangleNormal(positions, triangle);
+        
+        vec3 a = positions[edge.first.first], b = positions[edge.first.second];
+        vec3 borderNormal = glm::cross(b - a, normal);
+        ftype length = glm::length(borderNormal);
+        
+        if (length < 1e-12)
+            continue;
+        
+        borderNormal = borderNormal / length;
+        ftype borderWeight = glm::dot(b - a, b - a) * BORDER_PLANE_WEIGHT;
+        
+        quadrics[edge.first.first].addPlane(borderNormal, -glm::dot(borderNormal, a), borderWeight);
+        quadrics[edge.first.second].addPlane(borderNormal, -glm::dot(borderNormal, a), borderWeight);
+    }
+}
+
+SimplifiedTriangles sge::simplifyTriangles(const vector<vec3>& positions, const vector<int>& indices,
+                                           int targetTriangles, ftype maxError)
+{
+    SDL_assert(indices.size() % 3 == 0);
+    
+    int nVertices = (int)positions.size();
+    
+    SimplifiedTriangles result;
+    result.indices = indices;
+    result.sourceTriangles.resize(indices.size() / 3);
+    iota(result.sourceTriangles.begin(), result.sourceTriangles.end(), 0);
+    
+    vector<Quadric> quadrics;
+    computeQuadrics(positions, indices, quadrics);
+    
+    // texture seams: vertices with the same position but different attributes would drift apart
+    vector<uint8_t> locked(nVertices, 0);
+    map<tuple<ftype, ftype, ftype>, int> vertexAtPosition;
+    
+    for (int i = 0; i < nVertices; i++)
+    {
+        auto key = make_tuple(positions[i].x, positions[i].y, positions[i].z);
+        auto inserted = vertexAtPosition.insert(make_pair(key, i));
+        if (!inserted.second)
+            locked[i] = locked[inserted.first->second] = 1;
+    }
+    
+    ftype maxSquaredError = maxError * maxError;
+    ftype resultSquaredError = 0;
+    
+    vector<int> remap(nVertices);
+    vector<uint8_t> touched(nVertices);
+    vector<int> firstTriangle(nVertices + 1), vertexTriangles;
+    vector<EdgeCollapse> collapses;
+    
+    // every pass collapses independent edges, cheapest first
+    while (result.getTriangleCount() > targetTriangles)
+    {
+        const vector<int>& current = result.indices;
+        int nTriangles = result.getTriangleCount();
+        
+        fill(firstTriangle.begin(), firstTriangle.end(), 0);
+        for (int index: current)
+            firstTriangle[index + 1]++;
+        for (int i = 0; i < nVertices; i++)
+            firstTriangle[i + 1] += firstTriangle[i];
+        
+        vertexTriangles.resize(current.size());
+        vector<int> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+        for (int i = 0; i < (int)current.size(); i++)
+            vertexTriangles[filled[current[i]]++] = i / 3;
+        
+        collapses.clear();
+        
+        for (int i = 0; i < (int)current.size(); i++)
+        {
+            int from = current[i], to = current[i - i % 3 + (i + 1) % 3];
+            
+            // both directions of every edge, the second occurrence is skipped as touched
+            for (int direction = 0; direction < 2; direction++, swap(from, to))
+            {
+                if (locked[from])
+                    continue;
+                
+                Quadric merged = quadrics[from];
+                merged.add(quadrics[to]);
+                
+                ftype error = merged.evaluate(positions[to]);
+                if (error <= maxSquaredError)
+                    collapses.push_back(EdgeCollapse { from, to, error });
+            }
+        }
+        
+        if (collapses.empty())
+            break;
+        
+        sort(collapses.begin(), collapses.end(),
+             [] (const EdgeCollapse& a, const EdgeCollapse& b) { return a.error < b.error; });
+        
+        iota(remap.begin(), remap.end(), 0);
+        fill(touched.begin(), touched.end(), 0);
+        
+        int nToRemove = nTriangles - targetTriangles, nRemoved = 0;
+        
+        for (const EdgeCollapse& collapse: collapses)
+        {
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+            
+            bool flips = false;
+            int nCollapsed = 0;
+            
+            for (int k = firstTriangle[collapse.from]; k < firstTriangle[collapse.from + 1] && !flips; k++)
+            {
+                const int* triangle = &current[vertexTriangles[k] * 3];
+                
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    nCollapsed++;
+                    continue;
+                }
+                
+                int moved[3];
+                for (int corner = 0; corner < 3; corner++)
+                    moved[corner] = triangle[corner] == collapse.from ? collapse.to : triangle[corner];
+                
+                vec3 before = getTriangleNormal(positions, triangle), after = getTriangleNormal(positions, moved);
+                flips = glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after);
+            }
+            
+            if (flips)
+                continue;
+            
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            resultSquaredError = max(resultSquaredError, collapse.error);
+            
+            // triangles around the collapsed vertex changed, their vertices wait for the next pass
+            touched[collapse.to] = 1;
+            for (int k = firstTriangle[collapse.from]; k < firstTriangle[collapse.from + 1]; k++)
+                for (int corner = 0; corner < 3; corner++)
+                    touched[current[vertexTriangles[k] * 3 + corner]] = 1;
+            
+            nRemoved += nCollapsed;
+            if (nRemoved >= nToRemove)
+                break;
+        }
+        
+        if (nRemoved == 0)
+            break;
+        
+        vector<int> indicesLeft;
+        vector<int> sourcesLeft;
+        indicesLeft.reserve(current.size());
+        
+        for (int t = 0; t < nTriangles; t++)
+        {
+            int a = remap[current[t * 3]], b = remap[current[t * 3 + 1]], c = remap[current[t * 3 + 2]];
+            
+            if (a == b || b == c || a == c)
+                continue;
+            
+            indicesLeft.insert(indicesLeft.end(), { a, b, c });
+            sourcesLeft.push_back(result.sourceTriangles[t]);
+        }
+        
+        result.indices.swap(indicesLeft);
+        result.sourceTriangles.swap(sourcesLeft);
+    }
+    
+    result.error = sqrt(resultSquaredError);
+    return result;
+}
+
+vector<SimplifiedTriangles> sge::generateLodLevels(const vector<vec3>& positions, const vector<int>& indices,
+                                                   int nLevels, ftype maxError)
+{
+    vector<SimplifiedTriangles> levels;
+    
+    int nSourceTriangles = (int)indices.size() / 3;
+    int nPreviousTriangles = nSourceTriangles;
+    
+    // every level starts from the source, so the errors do not add up
+    for (int level = 1; level <= nLevels; level++)
+    {
+        int target = nSourceTriangles >> level;
+        if (target < 1)
+            break;
+        
+        SimplifiedTriangles simplified = simplifyTriangles(positions, indices, target, maxError);
+        
+        if (simplified.getTriangleCount() > nPreviousTriangles * LOD_MIN_REDUCTION)
+            break;
+        
+        nPreviousTriangles = simplified.getTriangleCount();
+        levels.push_back(move(simplified));
+    }
+    
+    return levels;
+}
+
+ftype sge::getProjectedSize(const mat4& projectionViewModelMatrix, const BoundingSphere& sphere)
+{
+    if (sphere.radius < 0)
+        return 0;
+    
+    // w is the view depth; the y row is the projection y scale times the model scale times a unit vector
+    const mat4& matrix = projectionViewModelMatrix;
+    ftype depth = (matrix * vec4(sphere.center, 1)).w;
+    ftype scaleY = glm::length(vec3(matrix[0][1], matrix[1][1], matrix[2][1]));
+    
+    // the depth is in world units, the radius is not
+    ftype modelScale = glm::length(vec3(matrix[0][3], matrix[1][3], matrix[2][3]));
+    
+    if (depth <= sphere.radius * modelScale)
+        return numeric_limits<ftype>::max();
+    
+    return sphere.radius * scaleY / depth;
+}
+
+void LodIndexRanges::addLevel(vector<GLuint>& elements, const vector<int>& levelIndices)
+{
+    firstIndex.push_back((int)elements.size());
+    indexCount.push_back((int)levelIndices.size());
+    
+    for (int index: levelIndices)
+        elements.push_back((GLuint)index);
+}
+
+int LodIndexRanges::clampLevel(int level) const
+{
+    SDL_assert(!firstIndex.empty());
+    return max(0, min(level, getLevelCount() - 1));
+}
+
+const GLvoid* LodIndexRanges::getIndexOffset(int level) const
+{
+    return (const GLvoid*)(firstIndex[clampLevel(level)] * sizeof(GLuint));
+}
+
+int LodSelector::select(int currentLevel, ftype projectedSize, int nLevels) const
+{
+    int level = max(0, min(currentLevel, nLevels - 1));
+    projectedSize *= sizeScale;
+    
+    int nThresholds = min(nLevels - 1, (int)screenSizes.size());
+    
+    while (level < nThresholds && projectedSize < screenSizes[level] * (1 - hysteresis))
+        level++;
+    
+    while (level > 0 && projectedSize > screenSizes[level - 1] * (1 + hysteresis))
+        level--;
+    
+    return level;
+}
@@ -0,0 +1,80 @@
+#ifndef SGE_MESH_LOD_H
+#define SGE_MESH_LOD_H
+
+#include "Common.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+
+namespace sge
+{
+
+// simplified levels generated for every mesh, in addition to the full one
+const int DEFAULT_LOD_LEVELS = 3;
+
+// the simplifier stops when a collapse would move the surface further than this, relative to the bounding radius
+const ftype LOD_MAX_RELATIVE_ERROR = 0.05;
+
+class SimplifiedTriangles
+{
+public :
+    std::vector<int> indices;
+    // original triangle of every output triangle, e.g. to keep a material per triangle
+    std::vector<int> sourceTriangles;
+    
+    // estimated distance from the original surface
+    ftype error = 0;
+    
+    int getTriangleCount() const { return (int)indices.size() / 3; }
+};
+
+// Quadric error edge collapses into existing vertices, so only the indices change & the vertex buffers are shared
+// between all levels. Vertices sharing a position with another vertex (texture seams) are never moved,
+// borders are kept in place by extra planes. Stops at targetTriangles or when maxError would be exceeded.
+SimplifiedTriangles simplifyTriangles(const std::vector<vec3>& positions, const std::vector<int>& indices,
+                                      int targetTriangles, ftype maxError);
+
+// level i has about 1 / 2^(i + 1) of the source triangles; fewer levels are made if the mesh does not simplify further
+std::vector<SimplifiedTriangles> generateLodLevels(const std::vector<vec3>& positions, const std::vector<int>& indices,
+                                                   int nLevels, ftype maxError);
+
+// Projected bounding sphere radius over half the screen height. The matrix is perspective * view * model
+// with a uniformly scaled model matrix, the sphere is in the space the model matrix is applied to.
+ftype getProjectedSize(const mat4& projectionViewModelMatrix, const BoundingSphere& sphere);
+
+// index ranges of the levels of a mesh in one element buffer, level 0 is the full mesh
+class LodIndexRanges
+{
+public :
+    std::vector<int> firstIndex, indexCount;
+    
+    // appends the level to the element buffer contents
+    void addLevel(std::vector<GLuint>& elements, const std::vector<int>& levelIndices);
+    
+    int getLevelCount() const { return (int)firstIndex.size(); }
+    
+    // levels past the coarsest one draw the coarsest one
+    int clampLevel(int level) const;
+    int getIndexCount(int level) const { return indexCount[clampLevel(level)]; }
+    const GLvoid* getIndexOffset(int level) const;
+};
+
+class LodSelector
+{
+public :
+    // level i + 1 is used when the projected size is below screenSizes[i]
+    std::vector<ftype> screenSizes { 0.25, 0.12, 0.05 };
+    
+    // a level is only left when the size is this much (relative) past its threshold, so objects
+    // standing right at a threshold do not switch levels every frame
+    ftype hysteresis = 0.2;
+    
+    // projected sizes are multiplied by it first, below 1 coarser levels are picked sooner
+    ftype sizeScale = 1;
+    
+    int select(int currentLevel, ftype projectedSize, int nLevels) const;
+};
+
+}
+
+#endif // SGE_MESH_LOD_H
@@ -0,0 +1,89 @@
+#include "ScpMeshCollection.h"
+#include "OcclusionCulling.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace sge;
+
+// Rasterizes the occluders of the game world into an OcclusionBuffer & tests a grid of boxes against it,
+// without a window or an OpenGL context.
+
+const int BENCHMARK_FRAMES = 200;
+const int BENCHMARK_VIEW_DIRECTIONS = 8;
+
+class PlacedOccluder
+{
+public :
+    const GLSimpleMesh* mesh;
+    mat4 modelMatrix;
+};
+
+int main(int /*argc*/, char** /*argv*/)
+{
+    ScpMeshCollection meshCollection;
+    meshCollection.geometryOnly = true;
+    meshCollection.loadMeshes();
+    
+    // the static world of GameController::initializeGraphics
+    vector<PlacedOccluder> occluders;
+    
+    for (int z = 5; z >= -20; z -= 3)
+        for (int t = 0; t < 2; t++)
+            occluders.push_back({ &meshCollection.cubeMesh, glm::translate(mat4(), vec3((t * 2 - 1) * 3, 0, z)) });
+    
+    occluders.push_back({ &meshCollection.plane, mat4() });
+    occluders.push_back({ &meshCollection.staircase,
+                          glm::translate(mat4(), vec3(0, 0, 5)) * glm::rotate(mat4(), M_PI, vec3(0, 1, 0)) });
+    
+    // small objects standing around, behind & in front of the occluders
+    BoxArrays boxes;
+    for (int x = -30; x < 30; x++)
+        for (int z = -40; z < 20; z++)
+        {
+            vec3 center(x + 0.5, 0.5, z + 0.5);
+            boxes.add(AxisAlignedBox(center - vec3(0.3, 0.3, 0.3), center + vec3(0.3, 0.3, 0.3)));
+        }
+    
+    OcclusionBuffer occlusionBuffer;
+    vector<uint8_t> visible;
+    
+    mat4 projectionMatrix = glm::perspective(45.0 / 180.0 * M_PI, 4.0 / 3.0, 0.1, 1e3);
+    vec3 eye(0, 1.7, 0);
+    
+    ftype rasterizeTime = 0, testTime = 0;
+    int nOccluderTriangles = 0, nTested = 0, nOccluded = 0;
+    
+    for (int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+    {
+        // the camera turns around, so every occluder is seen from the front
+        ftype angle = 2 * M_PI * (frame % BENCHMARK_VIEW_DIRECTIONS) / BENCHMARK_VIEW_DIRECTIONS;
+        mat4 viewMatrix = glm::lookAt(eye, eye + vec3(sin(angle), 0, -cos(angle)), vec3(0, 1, 0));
+        
+        occlusionBuffer.clear(projectionMatrix * viewMatrix);
+        
+        for (const PlacedOccluder& occluder: occluders)
+            occlusionBuffer.addOccluder(occluder.mesh->occluderTriangles, occluder.modelMatrix);
+        
+        occlusionBuffer.rasterize();
+        
+        visible.assign(boxes.size(), 1);
+        occlusionBuffer.testBoxes(boxes, visible);
+        
+        rasterizeTime += occlusionBuffer.rasterizeTime;
+        testTime += occlusionBuffer.testTime;
+        nOccluderTriangles += occlusionBuffer.nOccluderTriangles;
+        nTested += occlusionBuffer.nTestedBoxes;
+        nOccluded += occlusionBuffer.nOccludedBoxes;
+    }
+    
+    printf("occlusion buffer %d x %d, %d frames\n", occlusionBuffer.getWidth(), occlusionBuffer.getHeight(), BENCHMARK_FRAMES);
+    printf("rasterize: %.3f ms per frame, %d occluder triangles\n",
+           rasterizeTime / BENCHMARK_FRAMES, nOccluderTriangles / BENCHMARK_FRAMES);
+    printf("test boxes: %.3f ms per frame, %d tested, %d occluded\n",
+           testTime / BENCHMARK_FRAMES, nTested / BENCHMARK_FRAMES, nOccluded / BENCHMARK_FRAMES);
+    
+    return 0;
+}
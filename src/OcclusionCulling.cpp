@@ -0,0 +1,495 @@
+#include "OcclusionCulling.h"
+#include "Simd.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SGE_X86_KERNELS
+#endif
+
+using namespace std;
+using namespace sge;
+
+typedef void (*RasterKernel)(const OccluderTriangle& triangle, float* depth, int stride, int firstRow, int endRow);
+
+static void rasterizeTriangleScalar(const OccluderTriangle& triangle, float* depth, int stride, int firstRow, int endRow)
+{
+    int minY = max(triangle.minY, firstRow), maxY = min(triangle.maxY, endRow - 1);
+    
+    for (int y = minY; y <= maxY; y++)
+    {
+        float py = (float)y + 0.5f;
+        float* row = depth + y * stride;
+        
+        float rowEdge[3];
+        for (int k = 0; k < 3; k++)
+            rowEdge[k] = triangle.edgeB[k] * py + triangle.edgeC[k];
+        float rowDepth = triangle.depthB * py + triangle.depthC;
+        
+        for (int x = triangle.minX; x <= triangle.maxX; x++)
+        {
+            float px = (float)x + 0.5f;
+            
+            if (triangle.edgeA[0] * px + rowEdge[0] < 0 || triangle.edgeA[1] * px + rowEdge[1] < 0 ||
+                triangle.edgeA[2] * px + rowEdge[2] < 0)
+                continue;
+            
+            row[x] = min(row[x], triangle.depthA * px + rowDepth);
+        }
+    }
+}
+
+#ifdef SGE_X86_KERNELS
+
+// 4 pixels of a row at once, starting from an aligned column; rows are padded so the last group never leaves the row
+static void rasterizeTriangleSse(const OccluderTriangle& triangle, float* depth, int stride, int firstRow, int endRow)
+{
+    int minY = max(triangle.minY, firstRow), maxY = min(triangle.maxY, endRow - 1);
+    
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 pixelCenters = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    
+    __m128 edgeA0 = _mm_set1_ps(triangle.edgeA[0]), edgeA1 = _mm_set1_ps(triangle.edgeA[1]);
+    __m128 edgeA2 = _mm_set1_ps(triangle.edgeA[2]), depthA = _mm_set1_ps(triangle.depthA);
+    
+    for (int y = minY; y <= maxY; y++)
+    {
+        float py = (float)y + 0.5f;
+        float* row = depth + y * stride;
+        
+        __m128 rowEdge0 = _mm_set1_ps(triangle.edgeB[0] * py + triangle.edgeC[0]);
+        __m128 rowEdge1 = _mm_set1_ps(triangle.edgeB[1] * py + triangle.edgeC[1]);
+        __m128 rowEdge2 = _mm_set1_ps(triangle.edgeB[2] * py + triangle.edgeC[2]);
+        __m128 rowDepth = _mm_set1_ps(triangle.depthB * py + triangle.depthC);
+        
+        for (int x = triangle.minX & ~3; x <= triangle.maxX; x += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelCenters);
+            
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA0, px), rowEdge0), zero),
+                                       _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA1, px), rowEdge1), zero));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA2, px), rowEdge2), zero));
+            
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            
+            __m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthA, px), rowDepth);
+            __m128 oldDepth = _mm_loadu_ps(row + x);
+            __m128 newDepth = _mm_min_ps(oldDepth, pixelDepth);
+            
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+        }
+    }
+}
+
+#endif // SGE_X86_KERNELS
+
+static RasterKernel selectRasterKernel()
+{
+    // rows of a low resolution buffer are too short for 8 pixel groups to pay off, AVX2 uses the SSE kernel
+    switch (getSimdLevel())
+    {
+#ifdef SGE_X86_KERNELS
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE: return rasterizeTriangleSse;
+#else
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE:
+#endif
+        case SimdLevel::SCALAR: return rasterizeTriangleScalar;
+        default: unreachable();
+    }
+}
+
+void OcclusionBuffer::resize(int newWidth, int newHeight)
+{
+    verify(newWidth > 0 && newHeight > 0, "Occlusion buffer size must be positive, %d x %d given.", newWidth, newHeight);
+    
+    width = newWidth;
+    height = newHeight;
+    stride = (width + 3) & ~3;
+    
+    depth.assign((size_t)stride * height, 1.0f);
+}
+
+void OcclusionBuffer::clear(const mat4& projectionViewMatrix)
+{
+    for (int column = 0; column < 4; column++)
+        for (int row = 0; row < 4; row++)
+            projectionView[column * 4 + row] = (float)projectionViewMatrix[column][row];
+    
+    this->projectionViewMatrix = projectionViewMatrix;
+    
+    triangles.clear();
+    fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void OcclusionBuffer::addOccluder(const vector<vec3>& meshTriangles, const mat4& modelMatrix)
+{
+    SDL_assert(meshTriangles.size() % 3 == 0);
+    
+    mat4 transform = projectionViewMatrix * modelMatrix;
+    
+    for (int i = 0; i + 2 < (int)meshTriangles.size(); i += 3)
+    {
+        // x, y in pixels, z is the window depth
+        vec3 screen[3];
+        bool clipped = false;
+        
+        for (int corner = 0; corner < 3 && !clipped; corner++)
+        {
+            vec4 clip = transform * vec4(meshTriangles[i + corner], 1);
+            
+            // the GPU cuts a hole into a triangle crossing the near plane, anything behind it may be seen
+            if (clip.z < -clip.w)
+                clipped = true;
+            else
+                screen[corner] = vec3((clip.x / clip.w * 0.5 + 0.5) * width, (clip.y / clip.w * 0.5 + 0.5) * height,
+                                      clip.z / clip.w * 0.5 + 0.5);
+        }
+        
+        if (clipped)
+            continue;
+        
+        ftype area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) -
+                     (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        
+        if (abs(area) < 1e-6)
+            continue;
+        
+        // both sides are rasterized, edge functions are made positive inside
+        if (area < 0)
+        {
+            swap(screen[1], screen[2]);
+            area = -area;
+        }
+        
+        OccluderTriangle triangle;
+        
+        triangle.minX = max(0, (int)ceil(min(min(screen[0].x, screen[1].x), screen[2].x) - 0.5));
+        triangle.maxX = min(width - 1, (int)floor(max(max(screen[0].x, screen[1].x), screen[2].x) - 0.5));
+        triangle.minY = max(0, (int)ceil(min(min(screen[0].y, screen[1].y), screen[2].y) - 0.5));
+        triangle.maxY = min(height - 1, (int)floor(max(max(screen[0].y, screen[1].y), screen[2].y) - 0.5));
+        
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            continue;
+        
+        ftype depthA = 0, depthB = 0, depthC = 0;
+        
+        // edge k is opposite to corner k, its function is the doubled area of (a, b, p)
+        for (int k = 0; k < 3; k++)
+        {
+            const vec3& a = screen[(k + 1) % 3];
+            const vec3& b = screen[(k + 2) % 3];
+            
+            ftype edgeA = a.y - b.y, edgeB = b.x - a.x;
+            ftype edgeC = -(edgeA * a.x + edgeB * a.y);
+            
+            // the kernels sample pixel centers, moved inside by half a pixel only pixels covered completely pass
+            ftype shrink = 0.5 * (abs(edgeA) + abs(edgeB));
+            
+            triangle.edgeA[k] = (float)edgeA;
+            triangle.edgeB[k] = (float)edgeB;
+            triangle.edgeC[k] = (float)(edgeC - shrink);
+            
+            // edge k over the area is the barycentric coordinate of corner k
+            depthA += edgeA * screen[k].z / area;
+            depthB += edgeB * screen[k].z / area;
+            depthC += edgeC * screen[k].z / area;
+        }
+        
+        // the farthest depth of the triangle over a pixel, not the one at its center
+        triangle.depthA = (float)depthA;
+        triangle.depthB = (float)depthB;
+        triangle.depthC = (float)(depthC + 0.5 * (abs(depthA) + abs(depthB)));
+        
+        triangles.push_back(triangle);
+    }
+}
+
+void OcclusionBuffer::rasterizeBand(int firstRow, int endRow)
+{
+    static RasterKernel kernel = selectRasterKernel();
+    
+    for (const OccluderTriangle& triangle: triangles)
+        if (triangle.maxY >= firstRow && triangle.minY < endRow)
+            kernel(triangle, depth.data(), stride, firstRow, endRow);
+}
+
+void OcclusionBuffer::rasterize()
+{
+    Uint64 startTime = SDL_GetPerformanceCounter();
+    
+    nOccluderTriangles = (int)triangles.size();
+    
+    if (!triangles.empty())
+    {
+        WorkerPool::instance().submitRanges(tasks, 0, height, OCCLUSION_BAND_ROWS,
+                                            [this] (int firstRow, int endRow)
+                                            {
+                                                rasterizeBand(firstRow, endRow);
+                                            });
+        tasks.wait();
+    }
+    
+    rasterizeTime = (ftype)(SDL_GetPerformanceCounter() - startTime) * 1000.0 / (ftype)SDL_GetPerformanceFrequency();
+}
+
+bool OcclusionBuffer::isBoxOccluded(const float center[3], const float halfExtent[3]) const
+{
+    const float* m = projectionView;
+    
+    float minX = numeric_limits<float>::max(), minY = minX, nearestDepth = minX;
+    float maxX = -minX, maxY = -minX;
+    
+    for (int corner = 0; corner < 8; corner++)
+    {
+        float x = center[0] + ((corner & 1) ? halfExtent[0] : -halfExtent[0]);
+        float y = center[1] + ((corner & 2) ? halfExtent[1] : -halfExtent[1]);
+        float z = center[2] + ((corner & 4) ? halfExtent[2] : -halfExtent[2]);
+        
+        float clipX = m[0] * x + m[4] * y + m[8] * z + m[12];
+        float clipY = m[1] * x + m[5] * y + m[9] * z + m[13];
+        float clipZ = m[2] * x + m[6] * y + m[10] * z + m[14];
+        float clipW = m[3] * x + m[7] * y + m[11] * z + m[15];
+        
+        // reaches the camera, nothing can be in front of it
+        if (clipZ < -clipW)
+            return false;
+        
+        float inverseW = 1.0f / clipW;
+        float screenX = (clipX * inverseW * 0.5f + 0.5f) * (float)width;
+        float screenY = (clipY * inverseW * 0.5f + 0.5f) * (float)height;
+        
+        minX = min(minX, screenX);
+        maxX = max(maxX, screenX);
+        minY = min(minY, screenY);
+        maxY = max(maxY, screenY);
+        nearestDepth = min(nearestDepth, clipZ * inverseW * 0.5f + 0.5f);
+    }
+    
+    // every pixel the box touches
+    int firstX = max(0, (int)floor(minX)), lastX = min(width - 1, (int)floor(maxX));
+    int firstY = max(0, (int)floor(minY)), lastY = min(height - 1, (int)floor(maxY));
+    
+    // off screen boxes are left to the frustum test
+    if (firstX > lastX || firstY > lastY)
+        return false;
+    
+    for (int y = firstY; y <= lastY; y++)
+    {
+        const float* row = &depth[y * stride];
+        
+        for (int x = firstX; x <= lastX; x++)
+            if (row[x] >= nearestDepth)
+                return false;
+    }
+    
+    return true;
+}
+
+void OcclusionBuffer::testBoxRange(const BoxArrays& boxes, vector<uint8_t>& visible, int begin, int end,
+                                   atomic<int>& nTested, atomic<int>& nOccluded) const
+{
+    int nRangeTested = 0, nRangeOccluded = 0;
+    
+    for (int i = begin; i < end; i++)
+    {
+        if (!visible[i])
+            continue;
+        
+        float center[3] = { boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i] };
+        float halfExtent[3] = { boxes.halfExtentX[i], boxes.halfExtentY[i], boxes.halfExtentZ[i] };
+        
+        nRangeTested++;
+        
+        if (isBoxOccluded(center, halfExtent))
+        {
+            visible[i] = 0;
+            nRangeOccluded++;
+        }
+    }
+    
+    nTested += nRangeTested;
+    nOccluded += nRangeOccluded;
+}
+
+void OcclusionBuffer::testBoxes(const BoxArrays& boxes, vector<uint8_t>& visible)
+{
+    SDL_assert((int)visible.size() >= boxes.size());
+    
+    Uint64 startTime = SDL_GetPerformanceCounter();
+    
+    atomic<int> nTested(0), nOccluded(0);
+    
+    WorkerPool::instance().submitRanges(tasks, 0, boxes.size(), OCCLUSION_TEST_RANGE_BOXES,
+                                        [&] (int begin, int end)
+                                        {
+                                            testBoxRange(boxes, visible, begin, end, nTested, nOccluded);
+                                        });
+    tasks.wait();
+    
+    nTestedBoxes = nTested;
+    nOccludedBoxes = nOccluded;
+    testTime = (ftype)(SDL_GetPerformanceCounter() - startTime) * 1000.0 / (ftype)SDL_GetPerformanceFrequency();
+}
+
+bool OcclusionBuffer::isOccluded(const AxisAlignedBox& box) const
+{
+    if (box.isEmpty())
+        return true;
+    
+    vec3 boxCenter = box.getCenter(), boxHalfExtent = box.getHalfExtent();
+    
+    float center[3] = { (float)boxCenter.x, (float)boxCenter.y, (float)boxCenter.z };
+    float halfExtent[3] = { (float)boxHalfExtent.x, (float)boxHalfExtent.y, (float)boxHalfExtent.z };
+    
+    return isBoxOccluded(center, halfExtent);
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+    for (OcclusionQueryState& state: states)
+        if (state.query)
+            glDeleteQueries(1, &state.query);
+    
+    if (boxVertexArray)
+    {
+        glDeleteVertexArrays(1, &boxVertexArray);
+        glDeleteBuffers(1, &boxVertexBuffer);
+        glDeleteBuffers(1, &boxIndexBuffer);
+    }
+}
+
+void OcclusionQueries::createBoxMesh()
+{
+    float vertices[8 * 3];
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vertices[corner * 3 + 0] = (corner & 1) ? 1.0f : -1.0f;
+        vertices[corner * 3 + 1] = (corner & 2) ? 1.0f : -1.0f;
+        vertices[corner * 3 + 2] = (corner & 4) ? 1.0f : -1.0f;
+    }
+    
+    // two triangles per side, corners are indexed by their xyz bits
+    const GLuint indices[36] =
+    {
+        0, 2, 3, 0, 3, 1,
+        4, 5, 7, 4, 7, 6,
+        0, 4, 6, 0, 6, 2,
+        1, 3, 7, 1, 7, 5,
+        0, 1, 5, 0, 5, 4,
+        2, 6, 7, 2, 7, 3
+    };
+    
+    glGenVertexArrays(1, &boxVertexArray);
+    glBindVertexArray(boxVertexArray);
+    
+    glGenBuffers(1, &boxVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, boxVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, nullptr);
+    
+    glGenBuffers(1, &boxIndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxIndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void OcclusionQueries::collectResults(int nObjects)
+{
+    frame++;
+    nQueriesIssued = nResultsRead = nConditionalDraws = 0;
+    
+    states.resize(nObjects);
+    
+    for (OcclusionQueryState& state: states)
+    {
+        if (!state.pending)
+            continue;
+        
+        GLuint available = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        
+        if (!available)
+            continue;
+        
+        GLuint samples = 0;
+        glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &samples);
+        
+        state.visible = samples > 0;
+        state.pending = false;
+        nResultsRead++;
+    }
+}
+
+void OcclusionQueries::beginQueries()
+{
+    if (!boxVertexArray)
+        createBoxMesh();
+    
+    glUseProgram(0);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    
+    glBindVertexArray(boxVertexArray);
+}
+
+void OcclusionQueries::endQueries()
+{
+    glBindVertexArray(0);
+    
+    glDepthMask(GL_TRUE);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+bool OcclusionQueries::issueQuery(int object, const mat4& projectionViewMatrix, const AxisAlignedBox& worldBox)
+{
+    OcclusionQueryState& state = states[object];
+    
+    if (state.pending)
+        return false;
+    
+    // spread the re-tests of visible objects over frames
+    if (state.visible && state.query && (frame + object) % visibleRetestInterval != 0)
+        return false;
+    
+    if (!state.query)
+        glGenQueries(1, &state.query);
+    
+    vec3 halfExtent = worldBox.getHalfExtent() + vec3(OCCLUSION_QUERY_BOX_MARGIN);
+    mat4 boxMatrix = glm::scale(glm::translate(mat4(), worldBox.getCenter()), halfExtent);
+    
+    glLoadMatrixd(glm::value_ptr(projectionViewMatrix * boxMatrix));
+    
+    glBeginQuery(GL_SAMPLES_PASSED, state.query);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+    glEndQuery(GL_SAMPLES_PASSED);
+    
+    state.pending = true;
+    nQueriesIssued++;
+    
+    return true;
+}
+
+void OcclusionQueries::beginConditionalRender(int object)
+{
+    SDL_assert(states[object].query);
+    
+    // the object is drawn if the result is not ready yet, so it never lags behind the camera
+    glBeginConditionalRender(states[object].query, GL_QUERY_NO_WAIT);
+    nConditionalDraws++;
+}
+
+void OcclusionQueries::endConditionalRender()
+{
+    glEndConditionalRender();
+}
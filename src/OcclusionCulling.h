@@ -0,0 +1,146 @@
+#ifndef SGE_OCCLUSION_CULLING_H
+#define SGE_OCCLUSION_CULLING_H
+
+#include "Common.h"
+#include "BoundingVolumes.h"
+#include "WorkerPool.h"
+
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+namespace sge
+{
+
+// rows rasterized by one task, occluders are binned into bands so no pixel is shared between tasks
+const int OCCLUSION_BAND_ROWS = 16;
+
+// boxes tested by one task
+const int OCCLUSION_TEST_RANGE_BOXES = 256;
+
+// edge functions & depth plane of a screen space occluder triangle, evaluated at pixel centers;
+// the edges are positive at pixels the triangle covers completely, the depth is the farthest over the pixel
+class OccluderTriangle
+{
+public :
+    float edgeA[3], edgeB[3], edgeC[3];
+    float depthA, depthB, depthC;
+    
+    // pixels with centers inside the unshrunk triangle, inclusive
+    int minX, maxX, minY, maxY;
+};
+
+// Low resolution depth buffer the occluders (big walls & floors) are rasterized into on the CPU,
+// boxes with no pixel in front of the occluders are not drawn. Nothing is read back from the GPU.
+// Depth is the window depth (NDC z / 2 + 0.5), every pixel keeps the closest occluder. Only pixels an occluder
+// covers completely are written, with its farthest depth over the pixel, so a box seen past the edge
+// of an occluder is never hidden by it.
+class OcclusionBuffer
+{
+    int width = 0, height = 0;
+    // rows are padded to a multiple of 4 floats
+    int stride = 0;
+    std::vector<float> depth;
+    
+    mat4 projectionViewMatrix;
+    // column-major floats for the box tests
+    float projectionView[16];
+    std::vector<OccluderTriangle> triangles;
+    
+    TaskGroup tasks;
+    
+    void rasterizeBand(int firstRow, int endRow);
+    bool isBoxOccluded(const float center[3], const float halfExtent[3]) const;
+    void testBoxRange(const BoxArrays& boxes, std::vector<uint8_t>& visible, int begin, int end,
+                      std::atomic<int>& nTested, std::atomic<int>& nOccluded) const;
+
+public :
+    // of the last frame, in milliseconds
+    ftype rasterizeTime = 0, testTime = 0;
+    int nOccluderTriangles = 0, nTestedBoxes = 0, nOccludedBoxes = 0;
+    
+    OcclusionBuffer() { resize(256, 128); }
+    
+    void resize(int newWidth, int newHeight);
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    
+    // starts a frame: forgets the occluders & resets the depth
+    void clear(const mat4& projectionViewMatrix);
+    
+    // triangle list in mesh space; triangles crossing the near plane are dropped, which is conservative
+    void addOccluder(const std::vector<vec3>& meshTriangles, const mat4& modelMatrix);
+    
+    // the rows are split between WorkerPool threads, returns when the buffer is complete
+    void rasterize();
+    
+    // boxes with visible[i] set are tested, the occluded ones are reset
+    void testBoxes(const BoxArrays& boxes, std::vector<uint8_t>& visible);
+    bool isOccluded(const AxisAlignedBox& box) const;
+    
+    float getDepth(int x, int y) const { return depth[y * stride + x]; }
+};
+
+// world units every query box is grown by, so flat meshes & meshes touching their box are not hidden by themselves
+const ftype OCCLUSION_QUERY_BOX_MARGIN = 0.05;
+
+// objects this close to the camera are never queried, well beyond the near plane
+const ftype OCCLUSION_QUERY_CAMERA_DISTANCE = 1.0;
+
+class OcclusionQueryState
+{
+public :
+    GLuint query = 0;
+    // issued, the result is not read yet
+    bool pending = false;
+    // last known result, objects are visible until a query proves otherwise
+    bool visible = true;
+};
+
+// Hardware occlusion queries of object boxes with temporal coherence: a result is only read once
+// the GPU reports it available (usually the next frame), so the CPU never waits. Hidden objects are
+// queried every frame and drawn with conditional rendering on their latest query, visible ones are
+// only re-tested every visibleRetestInterval frames.
+class OcclusionQueries
+{
+    std::vector<OcclusionQueryState> states;
+    int frame = 0;
+    
+    // unit cube drawn for the queries
+    GLuint boxVertexArray = 0, boxVertexBuffer = 0, boxIndexBuffer = 0;
+    
+    void createBoxMesh();
+
+public :
+    int visibleRetestInterval = 4;
+    
+    // of the current frame
+    int nQueriesIssued = 0, nResultsRead = 0, nConditionalDraws = 0;
+    
+    OcclusionQueries() {}
+    OcclusionQueries(const OcclusionQueries&) = delete;
+    OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+    ~OcclusionQueries();
+    
+    // starts a frame: reads every available result without waiting
+    void collectResults(int nObjects);
+    
+    bool isVisible(int object) const { return states[object].visible; }
+    bool hasQuery(int object) const { return states[object].query != 0; }
+    void markVisible(int object) { states[object].visible = true; }
+    
+    // depth & color writes are disabled between these, the depth of everything drawn before is used
+    void beginQueries();
+    void endQueries();
+    
+    // false if the object is not due: its previous query is still pending or it was visible recently
+    bool issueQuery(int object, const mat4& projectionViewMatrix, const AxisAlignedBox& worldBox);
+    
+    // draws in between are skipped by the GPU if the latest query of the object found no samples
+    void beginConditionalRender(int object);
+    void endConditionalRender();
+};
+
+}
+
+#endif // SGE_OCCLUSION_CULLING_H
@@ -0,0 +1,266 @@
+#include "PortalVisibility.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+// chains of doorways longer than this are not followed
+const int MAX_PORTAL_DEPTH = 64;
+
+// visits of every cell in one computeVisibility; graphs with many doorway cycles have exponentially many paths,
+// past this portals cull nothing for the frame
+const int MAX_VISITS_PER_CELL = 16;
+
+// portal points closer to the camera plane are clipped away
+const ftype PORTAL_NEAR_W = 1e-4;
+
+static ScreenRect emptyScreenRect()
+{
+    ScreenRect rect;
+    rect.minX = rect.minY = 1;
+    rect.maxX = rect.maxY = -1;
+    return rect;
+}
+
+ScreenRect ScreenRect::intersected(const ScreenRect& other) const
+{
+    ScreenRect result;
+    result.minX = max(minX, other.minX);
+    result.minY = max(minY, other.minY);
+    result.maxX = min(maxX, other.maxX);
+    result.maxY = min(maxY, other.maxY);
+    return result;
+}
+
+void ScreenRect::add(const ScreenRect& other)
+{
+    if (other.isEmpty())
+        return;
+    
+    if (isEmpty())
+    {
+        *this = other;
+        return;
+    }
+    
+    minX = min(minX, other.minX);
+    minY = min(minY, other.minY);
+    maxX = max(maxX, other.maxX);
+    maxY = max(maxY, other.maxY);
+}
+
+mat4 ScreenRect::getClipMatrix() const
+{
+    SDL_assert(!isEmpty());
+    
+    // x' = (2x - (minX + maxX) w) / (maxX - minX), the same for y; z & w are kept
+    mat4 matrix;
+    matrix[0][0] = 2 / (maxX - minX);
+    matrix[1][1] = 2 / (maxY - minY);
+    matrix[3][0] = -(minX + maxX) / (maxX - minX);
+    matrix[3][1] = -(minY + maxY) / (maxY - minY);
+    return matrix;
+}
+
+// screen rectangle of the part of the polygon in front of the camera, false if nothing is
+static bool projectPortal(const vector<vec3>& polygon, const mat4& projectionViewMatrix, ScreenRect& rect)
+{
+    vector<vec4> clipped;
+    clipped.reserve(polygon.size() + 1);
+    
+    for (int i = 0; i < (int)polygon.size(); i++)
+    {
+        vec4 a = projectionViewMatrix * vec4(polygon[i], 1);
+        vec4 b = projectionViewMatrix * vec4(polygon[(i + 1) % polygon.size()], 1);
+        
+        ftype distanceA = a.w - PORTAL_NEAR_W, distanceB = b.w - PORTAL_NEAR_W;
+        
+        if (distanceA >= 0)
+            clipped.push_back(a);
+        
+        if ((distanceA >= 0) != (distanceB >= 0))
+            clipped.push_back(a + (b - a) * (distanceA / (distanceA - distanceB)));
+    }
+    
+    if (clipped.empty())
+        return false;
+    
+    rect = emptyScreenRect();
+    
+    for (const vec4& point: clipped)
+    {
+        ftype x = point.x / point.w, y = point.y / point.w;
+        
+        rect.minX = min(rect.minX, x);
+        rect.minY = min(rect.minY, y);
+        rect.maxX = max(rect.maxX, x);
+        rect.maxY = max(rect.maxY, y);
+    }
+    
+    return true;
+}
+
+void CellPortalGraph::clear()
+{
+    cells.clear();
+    portals.clear();
+    cellVisible.clear();
+    cellRects.clear();
+    cameraCell = -1;
+}
+
+int CellPortalGraph::addCell(const AxisAlignedBox& bounds)
+{
+    PortalCell cell;
+    cell.bounds = bounds;
+    cells.push_back(cell);
+    
+    return (int)cells.size() - 1;
+}
+
+void CellPortalGraph::addPortal(int cell, const vector<vec3>& polygon)
+{
+    SDL_assert(cell >= 0 && cell < (int)cells.size());
+    verify(polygon.size() >= 3, "Portal polygon needs at least 3 vertices, %d given.", (int)polygon.size());
+    
+    Portal portal;
+    portal.polygon = polygon;
+    portal.cell = cell;
+    
+    cells[cell].portals.push_back((int)portals.size());
+    portals.push_back(portal);
+}
+
+static vec3 getCentroid(const vector<vec3>& polygon)
+{
+    vec3 sum;
+    for (const vec3& point: polygon)
+        sum += point;
+    
+    return sum / (ftype)polygon.size();
+}
+
+int CellPortalGraph::connectPortals(ftype tolerance)
+{
+    vector<vec3> centroids;
+    for (const Portal& portal: portals)
+        centroids.push_back(getCentroid(portal.polygon));
+    
+    int nDoorways = 0;
+    
+    for (int i = 0; i < (int)portals.size(); i++)
+        for (int j = i + 1; j < (int)portals.size() && portals[i].twin < 0; j++)
+        {
+            if (portals[j].twin >= 0 || portals[j].cell == portals[i].cell)
+                continue;
+            
+            if (glm::length(centroids[i] - centroids[j]) > tolerance)
+                continue;
+            
+            portals[i].twin = j;
+            portals[j].twin = i;
+            nDoorways++;
+        }
+    
+    return nDoorways;
+}
+
+int CellPortalGraph::findCell(vec3 point) const
+{
+    int found = -1;
+    ftype foundVolume = 0;
+    
+    for (int i = 0; i < (int)cells.size(); i++)
+    {
+        const AxisAlignedBox& bounds = cells[i].bounds;
+        
+        bool inside = true;
+        for (int axis = 0; axis < 3; axis++)
+            inside = inside && point[axis] >= bounds.minCorner[axis] && point[axis] <= bounds.maxCorner[axis];
+        
+        if (!inside)
+            continue;
+        
+        vec3 size = bounds.maxCorner - bounds.minCorner;
+        ftype volume = size.x * size.y * size.z;
+        
+        if (found < 0 || volume < foundVolume)
+        {
+            found = i;
+            foundVolume = volume;
+        }
+    }
+    
+    return found;
+}
+
+void CellPortalGraph::visitCell(int cell, const ScreenRect& rect, const mat4& projectionViewMatrix, int depth)
+{
+    if (++nCellVisits > MAX_VISITS_PER_CELL * (int)cells.size())
+    {
+        visitBudgetExceeded = true;
+        return;
+    }
+    
+    cellVisible[cell] = 1;
+    cellRects[cell].add(rect);
+    
+    if (depth >= MAX_PORTAL_DEPTH)
+        return;
+    
+    for (int portalIndex: cells[cell].portals)
+    {
+        int twin = portals[portalIndex].twin;
+        
+        // a cell on the path was entered through a bigger rectangle with fewer cells on the path,
+        // everything seen from it again was already seen then; this also keeps from walking back
+        if (twin < 0 || cellOnPath[portals[twin].cell])
+            continue;
+        
+        nPortalsTested++;
+        
+        ScreenRect portalRect;
+        if (!projectPortal(portals[portalIndex].polygon, projectionViewMatrix, portalRect))
+            continue;
+        
+        ScreenRect narrowed = rect.intersected(portalRect);
+        if (narrowed.isEmpty())
+            continue;
+        
+        int neighbour = portals[twin].cell;
+        
+        cellOnPath[neighbour] = 1;
+        visitCell(neighbour, narrowed, projectionViewMatrix, depth + 1);
+        cellOnPath[neighbour] = 0;
+    }
+}
+
+bool CellPortalGraph::computeVisibility(const mat4& projectionViewMatrix, vec3 cameraPosition)
+{
+    cellVisible.assign(cells.size(), 0);
+    cellRects.assign(cells.size(), emptyScreenRect());
+    nPortalsTested = 0;
+    
+    cameraCell = findCell(cameraPosition);
+    if (cameraCell < 0)
+        return false;
+    
+    cellOnPath.assign(cells.size(), 0);
+    cellOnPath[cameraCell] = 1;
+    
+    nCellVisits = 0;
+    visitBudgetExceeded = false;
+    
+    visitCell(cameraCell, ScreenRect(), projectionViewMatrix, 0);
+    
+    return !visitBudgetExceeded;
+}
+
+vec3 sge::getCameraPosition(const mat4& projectionViewMatrix)
+{
+    // clip (0, 0, z, 0) is the only point a perspective matrix sends to w == 0
+    vec4 camera = glm::inverse(projectionViewMatrix) * vec4(0, 0, 1, 0);
+    return vec3(camera) / camera.w;
+}
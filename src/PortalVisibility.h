@@ -0,0 +1,92 @@
+#ifndef SGE_PORTAL_VISIBILITY_H
+#define SGE_PORTAL_VISIBILITY_H
+
+#include "Common.h"
+#include "BoundingVolumes.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+// rectangle in normalized device coordinates, the whole screen by default
+class ScreenRect
+{
+public :
+    ftype minX = -1, minY = -1, maxX = 1, maxY = 1;
+    
+    bool isEmpty() const { return minX >= maxX || minY >= maxY; }
+    
+    ScreenRect intersected(const ScreenRect& other) const;
+    void add(const ScreenRect& other);
+    
+    // maps the rectangle to the whole clip volume, Frustum(getClipMatrix() * projectionView) is the narrowed frustum
+    mat4 getClipMatrix() const;
+};
+
+// convex doorway polygon in world space, seen from inside its cell
+class Portal
+{
+public :
+    std::vector<vec3> polygon;
+    
+    int cell = -1;
+    // the coincident portal of the neighbour cell, -1 for a portal leading nowhere
+    int twin = -1;
+};
+
+class PortalCell
+{
+public :
+    // used to find the cell of the camera
+    AxisAlignedBox bounds;
+    std::vector<int> portals;
+};
+
+// Rooms are cells, doorways are portals. Starting from the camera cell, a neighbour is visible
+// if its portal projects into the screen rectangle it was reached through; the rectangle is
+// narrowed to the portal at every step, so only what can be seen through the chain of doorways is reached.
+class CellPortalGraph
+{
+    // cells entered on the way to the cell being visited, including it
+    std::vector<uint8_t> cellOnPath;
+    
+    int nCellVisits = 0;
+    bool visitBudgetExceeded = false;
+    
+    void visitCell(int cell, const ScreenRect& rect, const mat4& projectionViewMatrix, int depth);
+
+public :
+    std::vector<PortalCell> cells;
+    std::vector<Portal> portals;
+    
+    // of the last computeVisibility
+    std::vector<uint8_t> cellVisible;
+    // union of the rectangles every cell was seen through
+    std::vector<ScreenRect> cellRects;
+    int cameraCell = -1;
+    int nPortalsTested = 0;
+    
+    void clear();
+    
+    int addCell(const AxisAlignedBox& bounds);
+    void addPortal(int cell, const std::vector<vec3>& polygon);
+    
+    // portals of different cells with the same centroid become one doorway, returns the number of doorways
+    int connectPortals(ftype tolerance = 1e-2);
+    
+    // smallest cell containing the point, -1 if there is none
+    int findCell(vec3 point) const;
+    
+    // false if the camera is outside every cell or the graph has too many paths to walk,
+    // nothing can be culled by portals then
+    bool computeVisibility(const mat4& projectionViewMatrix, vec3 cameraPosition);
+};
+
+// perspective projections only: the camera is the point with clip w == 0
+vec3 getCameraPosition(const mat4& projectionViewMatrix);
+
+}
+
+#endif // SGE_PORTAL_VISIBILITY_H
@@ -0,0 +1,167 @@
+#include "QualityGovernor.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+// from full quality down, the resolution goes first as it costs nothing but sharpness
+static const QualitySettings qualityLevels[] =
+{
+    { 1.0, 1.0, true },
+    { 0.85, 1.0, true },
+    { 0.7, 1.0, true },
+    { 0.6, 1.0, true },
+    { 0.5, 1.0, true },
+    { 0.5, 0.6, true },
+    { 0.5, 0.6, false },
+    { 0.5, 0.35, false }
+};
+
+static const int nQualityLevels = (int)(sizeof(qualityLevels) / sizeof(qualityLevels[0]));
+
+// relative to the budget; the gap between them keeps a level which just fits from being raised
+const ftype SLOW_FRAME_BUDGET_SHARE = 0.95;
+const ftype FAST_FRAME_BUDGET_SHARE = 0.7;
+
+const int SLOW_FRAMES_TO_LOWER = 15;
+const int FAST_FRAMES_TO_RAISE = 180;
+// the averages need time to show the new level
+const int COOLDOWN_FRAMES = 30;
+
+const ftype AVERAGE_WEIGHT = 0.1;
+
+static ftype updateAverage(ftype average, ftype value, bool first)
+{
+    return first ? value : average + (value - average) * AVERAGE_WEIGHT;
+}
+
+void QualityGovernor::readQueries()
+{
+    for (int i = 0; i < QUALITY_GOVERNOR_QUERIES; i++)
+    {
+        if (!queryPending[i])
+            continue;
+        
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+        queryPending[i] = false;
+        
+        averageGpuTime = updateAverage(averageGpuTime, (ftype)nanoseconds / 1e6, !gpuTimeKnown);
+        gpuTimeKnown = true;
+    }
+}
+
+void QualityGovernor::beginFrame()
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    
+    if (lastFrameStart)
+    {
+        ftype frameTime = (ftype)(now - lastFrameStart) * 1000.0 / (ftype)SDL_GetPerformanceFrequency();
+        averageFrameTime = updateAverage(averageFrameTime, frameTime, frame == 0);
+        frame++;
+    }
+    
+    lastFrameStart = now;
+    
+    if (!queries[0])
+        glGenQueries(QUALITY_GOVERNOR_QUERIES, queries);
+    
+    readQueries();
+    
+    // with all queries still in flight this frame is not timed
+    currentQuery = -1;
+    for (int i = 0; i < QUALITY_GOVERNOR_QUERIES && currentQuery == -1; i++)
+        if (!queryPending[i])
+            currentQuery = i;
+    
+    if (currentQuery != -1)
+        glBeginQuery(GL_TIME_ELAPSED, queries[currentQuery]);
+    
+    if (enabled && frame > 0)
+        adapt();
+}
+
+void QualityGovernor::endFrame()
+{
+    if (currentQuery == -1)
+        return;
+    
+    glEndQuery(GL_TIME_ELAPSED);
+    queryPending[currentQuery] = true;
+    currentQuery = -1;
+}
+
+void QualityGovernor::adapt()
+{
+    if (cooldownFrames > 0)
+    {
+        cooldownFrames--;
+        return;
+    }
+    
+    // the GPU time tells whether the GPU is what takes long, lower quality does not help a slow CPU;
+    // without it the frame time is all there is
+    ftype gpuTime = gpuTimeKnown ? averageGpuTime : averageFrameTime;
+    
+    bool slow = averageFrameTime > frameBudget && gpuTime > frameBudget * SLOW_FRAME_BUDGET_SHARE;
+    bool fast = averageFrameTime < frameBudget && gpuTime < frameBudget * FAST_FRAME_BUDGET_SHARE;
+    
+    slowFrames = slow ? slowFrames + 1 : 0;
+    fastFrames = fast ? fastFrames + 1 : 0;
+    
+    if (slowFrames >= SLOW_FRAMES_TO_LOWER && level + 1 < nQualityLevels)
+        setLevel(level + 1);
+    else if (fastFrames >= FAST_FRAMES_TO_RAISE && level > 0)
+        setLevel(level - 1);
+}
+
+void QualityGovernor::setLevel(int newLevel)
+{
+    level = newLevel;
+    
+    slowFrames = fastFrames = 0;
+    cooldownFrames = COOLDOWN_FRAMES;
+    
+    QualitySettings settings = getSettings();
+    printf("quality level %d: render scale %.2f, LOD size scale %.2f, optional effects %s (frame %.1f ms, GPU %.1f ms)\n",
+           level, settings.renderScale, settings.lodSizeScale, settings.optionalEffects ? "on" : "off",
+           averageFrameTime, averageGpuTime);
+}
+
+QualitySettings QualityGovernor::getSettings() const
+{
+    SDL_assert(level >= 0 && level < nQualityLevels);
+    return qualityLevels[level];
+}
+
+void QualityGovernor::reset()
+{
+    level = 0;
+    slowFrames = fastFrames = cooldownFrames = 0;
+    
+    frame = 0;
+    lastFrameStart = 0;
+    gpuTimeKnown = false;
+}
+
+void QualityGovernor::destroy()
+{
+    if (currentQuery != -1)
+        endFrame();
+    
+    if (queries[0])
+        glDeleteQueries(QUALITY_GOVERNOR_QUERIES, queries);
+    
+    for (int i = 0; i < QUALITY_GOVERNOR_QUERIES; i++)
+    {
+        queries[i] = 0;
+        queryPending[i] = false;
+    }
+}
@@ -0,0 +1,82 @@
+#ifndef SGE_QUALITY_GOVERNOR_H
+#define SGE_QUALITY_GOVERNOR_H
+
+#include "Common.h"
+
+namespace sge
+{
+
+// GPU timings are read this many frames late, so reading them never waits for the GPU
+const int QUALITY_GOVERNOR_QUERIES = 4;
+
+const ftype QUALITY_GOVERNOR_DEFAULT_BUDGET = 1000.0 / 60.0;
+
+class QualitySettings
+{
+public :
+    // of the window size, the scene is upscaled to the window
+    ftype renderScale = 1;
+    // multiplies projected sizes before the LOD thresholds, coarser levels are picked sooner below 1
+    ftype lodSizeScale = 1;
+    // blur & other post effects which can be skipped
+    bool optionalEffects = true;
+    
+    QualitySettings() {}
+    QualitySettings(ftype renderScale, ftype lodSizeScale, bool optionalEffects):
+        renderScale(renderScale), lodSizeScale(lodSizeScale), optionalEffects(optionalEffects) {}
+};
+
+// Watches recent frame & GPU times against a budget and moves between quality levels,
+// from full quality down through lower render scales, then coarser LODs & no optional effects.
+// Going down needs a short run of slow frames, going up a long run of fast ones with a margin
+// in between, & nothing changes for a while after every switch, so the level does not oscillate.
+class QualityGovernor
+{
+    GLuint queries[QUALITY_GOVERNOR_QUERIES] = {};
+    bool queryPending[QUALITY_GOVERNOR_QUERIES] = {};
+    int currentQuery = -1;
+    int frame = 0;
+    
+    Uint64 lastFrameStart = 0;
+    
+    // exponential averages in ms, the GPU one of the frames whose query results are in
+    ftype averageFrameTime = 0, averageGpuTime = 0;
+    bool gpuTimeKnown = false;
+    
+    int level = 0;
+    int slowFrames = 0, fastFrames = 0, cooldownFrames = 0;
+    
+    void readQueries();
+    void adapt();
+    void setLevel(int newLevel);
+
+public :
+    // when disabled the level stays at full quality
+    bool enabled = true;
+    
+    // in ms
+    ftype frameBudget = QUALITY_GOVERNOR_DEFAULT_BUDGET;
+    
+    QualityGovernor() {}
+    QualityGovernor(const QualityGovernor&) = delete;
+    ~QualityGovernor() { destroy(); }
+    
+    // around all GPU work of a frame
+    void beginFrame();
+    void endFrame();
+    
+    QualitySettings getSettings() const;
+    int getLevel() const { return level; }
+    
+    ftype getAverageFrameTime() const { return averageFrameTime; }
+    ftype getAverageGpuTime() const { return averageGpuTime; }
+    
+    // back to full quality, the averages are measured again
+    void reset();
+    
+    void destroy();
+};
+
+}
+
+#endif // SGE_QUALITY_GOVERNOR_H
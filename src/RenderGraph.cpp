@@ -0,0 +1,298 @@
+#include "RenderGraph.h"
+
+using namespace std;
+using namespace sge;
+
+bool RenderTargetDescription::operator==(const RenderTargetDescription& other) const
+{
+    return width == other.width && height == other.height &&
+           colorFormat == other.colorFormat && depthBuffer == other.depthBuffer;
+}
+
+void FullScreenRenderTarget::create(const RenderTargetDescription& newDescription)
+{
+    description = newDescription;
+    
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    glTexImage2D(GL_TEXTURE_2D, 0, description.colorFormat, description.width, description.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    if (description.depthBuffer)
+    {
+        glGenRenderbuffers(1, &zBufferRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, zBufferRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT,
+                              description.width, description.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+    
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textureId, 0);
+    if (description.depthBuffer)
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, zBufferRbo);
+    
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    SDL_assert(status == GL_FRAMEBUFFER_COMPLETE);
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FullScreenRenderTarget::destroy()
+{
+    if (textureId)
+    {
+        glDeleteTextures(1, &textureId);
+        textureId = 0;
+    }
+    if (zBufferRbo)
+    {
+        glDeleteRenderbuffers(1, &zBufferRbo);
+        zBufferRbo = 0;
+    }
+    
+    if (fbo)
+    {
+        glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
+    }
+}
+
+bool FullScreenRenderTarget::ensure(const RenderTargetDescription& newDescription)
+{
+    if (fbo && description == newDescription)
+        return false;
+    
+    destroy();
+    create(newDescription);
+    return true;
+}
+
+void FullScreenRenderTarget::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, description.width, description.height);
+}
+
+void FullScreenRenderTarget::renderScreenQuad()
+{
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glEnable(GL_TEXTURE_2D);
+    glLoadIdentity();
+    
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(-1, -1);
+    glTexCoord2f(0, 1); glVertex2f(-1, +1);
+    glTexCoord2f(1, 1); glVertex2f(+1, +1);
+    glTexCoord2f(1, 0); glVertex2f(+1, -1);
+    glEnd();
+    
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void RenderTargetPool::beginFrame()
+{
+    currentFrame++;
+    
+    for (auto it = targets.begin(); it != targets.end();)
+    {
+        if (!it->acquired && currentFrame - it->lastUsedFrame > RENDER_TARGET_POOL_KEEP_FRAMES)
+        {
+            it->target.destroy();
+            it = targets.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+FullScreenRenderTarget* RenderTargetPool::acquire(const RenderTargetDescription& description)
+{
+    for (PooledTarget& pooled: targets)
+    {
+        if (!pooled.acquired && pooled.target.description == description)
+        {
+            pooled.acquired = true;
+            pooled.lastUsedFrame = currentFrame;
+            return &pooled.target;
+        }
+    }
+    
+    targets.emplace_back();
+    PooledTarget& pooled = targets.back();
+    
+    pooled.target.create(description);
+    pooled.acquired = true;
+    pooled.lastUsedFrame = currentFrame;
+    
+    return &pooled.target;
+}
+
+void RenderTargetPool::release(FullScreenRenderTarget* target)
+{
+    for (PooledTarget& pooled: targets)
+    {
+        if (&pooled.target == target)
+        {
+            SDL_assert(pooled.acquired);
+            pooled.acquired = false;
+            pooled.lastUsedFrame = currentFrame;
+            return;
+        }
+    }
+    
+    critical_error("Released a render target which is not from the pool.");
+}
+
+void RenderTargetPool::destroy()
+{
+    for (PooledTarget& pooled: targets)
+        pooled.target.destroy();
+    
+    targets.clear();
+}
+
+int RenderGraph::createTarget(string name, const RenderTargetDescription& description)
+{
+    Resource resource;
+    resource.name = name;
+    resource.description = description;
+    
+    resources.push_back(resource);
+    return (int)resources.size() - 1;
+}
+
+int RenderGraph::importTarget(string name, FullScreenRenderTarget* target, const RenderTargetDescription& description)
+{
+    Resource resource;
+    resource.name = name;
+    resource.description = description;
+    resource.target = target;
+    resource.imported = true;
+    
+    resources.push_back(resource);
+    return (int)resources.size() - 1;
+}
+
+void RenderGraph::addPass(string name, vector<int> reads, vector<int> writes, RenderPassFunction execute)
+{
+    Pass pass;
+    pass.name = name;
+    pass.reads = reads;
+    pass.writes = writes;
+    pass.execute = execute;
+    
+    passes.push_back(pass);
+}
+
+FullScreenRenderTarget& RenderGraph::getTarget(int resource)
+{
+    SDL_assert(resource >= 0 && resource < (int)resources.size());
+    verify(resources[resource].target, "Render graph resource '%s' has no target at this point.",
+           resources[resource].name.c_str());
+    
+    return *resources[resource].target;
+}
+
+void RenderGraph::cullPasses()
+{
+    // imported targets are seen after the frame, what they depend on is needed
+    vector<bool> needed(resources.size());
+    for (int i = 0; i < (int)resources.size(); i++)
+        needed[i] = resources[i].imported;
+    
+    for (int i = (int)passes.size() - 1; i >= 0; i--)
+    {
+        Pass& pass = passes[i];
+        
+        pass.culled = !pass.writes.empty();
+        for (int resource: pass.writes)
+            if (needed[resource])
+                pass.culled = false;
+        
+        if (!pass.culled)
+            for (int resource: pass.reads)
+                needed[resource] = true;
+    }
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (int i = 0; i < (int)passes.size(); i++)
+    {
+        if (passes[i].culled)
+            continue;
+        
+        auto use = [&](int resourceIndex, bool written)
+        {
+            Resource& resource = resources[resourceIndex];
+            
+            if (resource.firstPass == -1)
+            {
+                verify(written || resource.imported, "Render pass '%s' reads '%s' before anything writes it.",
+                       passes[i].name.c_str(), resource.name.c_str());
+                resource.firstPass = i;
+            }
+            
+            resource.lastPass = i;
+        };
+        
+        for (int resource: passes[i].reads)
+            use(resource, false);
+        for (int resource: passes[i].writes)
+            use(resource, true);
+    }
+}
+
+void RenderGraph::execute()
+{
+    cullPasses();
+    computeLifetimes();
+    
+    for (int i = 0; i < (int)passes.size(); i++)
+    {
+        Pass& pass = passes[i];
+        if (pass.culled)
+            continue;
+        
+        for (Resource& resource: resources)
+            if (!resource.imported && resource.firstPass == i)
+                resource.target = pool.acquire(resource.description);
+        
+        if (!pass.writes.empty())
+        {
+            Resource& output = resources[pass.writes[0]];
+            
+            if (output.target)
+                output.target->bind();
+            else
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, output.description.width, output.description.height);
+            }
+        }
+        
+        pass.execute(*this);
+        
+        // the same memory may be written by the next passes under another name
+        for (Resource& resource: resources)
+        {
+            if (!resource.imported && resource.lastPass == i)
+            {
+                pool.release(resource.target);
+                resource.target = nullptr;
+            }
+        }
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,144 @@
+#ifndef SGE_RENDER_GRAPH_H
+#define SGE_RENDER_GRAPH_H
+
+#include "Common.h"
+
+#include <list>
+#include <vector>
+#include <string>
+#include <functional>
+
+namespace sge
+{
+
+// frames a free pooled target survives without being acquired; while a window is being resized
+// only the targets of the sizes which were actually rendered are created, and they go soon after
+const int RENDER_TARGET_POOL_KEEP_FRAMES = 3;
+
+class RenderTargetDescription
+{
+public :
+    int width = 0, height = 0;
+    GLenum colorFormat = GL_RGBA8;
+    bool depthBuffer = true;
+    
+    RenderTargetDescription() {}
+    RenderTargetDescription(int width, int height, GLenum colorFormat = GL_RGBA8, bool depthBuffer = true):
+        width(width), height(height), colorFormat(colorFormat), depthBuffer(depthBuffer) {}
+    
+    bool operator==(const RenderTargetDescription& other) const;
+    bool operator!=(const RenderTargetDescription& other) const { return !(*this == other); }
+};
+
+class FullScreenRenderTarget
+{
+public :
+    RenderTargetDescription description;
+    
+    GLuint textureId = 0;
+    GLuint zBufferRbo = 0;
+    GLuint fbo = 0;
+    
+    void create(const RenderTargetDescription& newDescription);
+    void destroy();
+    
+    // recreates the target if it does not match, so it can be called every frame;
+    // true if it was recreated & its contents are undefined
+    bool ensure(const RenderTargetDescription& newDescription);
+    
+    // the framebuffer & a viewport covering it
+    void bind() const;
+    
+    void renderScreenQuad();
+};
+
+// Transient targets shared by everything rendered, keyed by their descriptions.
+class RenderTargetPool
+{
+    class PooledTarget
+    {
+    public :
+        FullScreenRenderTarget target;
+        bool acquired = false;
+        int lastUsedFrame = 0;
+    };
+    
+    // a list, acquired targets are referenced by pointers
+    std::list<PooledTarget> targets;
+    int currentFrame = 0;
+
+public :
+    RenderTargetPool() {}
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    ~RenderTargetPool() { destroy(); }
+    
+    // destroys the free targets which were not used for RENDER_TARGET_POOL_KEEP_FRAMES frames
+    void beginFrame();
+    
+    FullScreenRenderTarget* acquire(const RenderTargetDescription& description);
+    void release(FullScreenRenderTarget* target);
+    
+    int getTargetCount() const { return (int)targets.size(); }
+    
+    void destroy();
+};
+
+class RenderGraph;
+typedef std::function<void(RenderGraph& graph)> RenderPassFunction;
+
+// Passes of one frame with the targets they read & write, executed in the order they were added.
+// Passes which contribute to no imported target are skipped. Transient targets are taken from the pool
+// before the first pass using them & given back after the last one, so a later target of the same
+// description reuses the memory of one which is no longer needed.
+class RenderGraph
+{
+    class Resource
+    {
+    public :
+        std::string name;
+        RenderTargetDescription description;
+        
+        // nullptr for the default framebuffer
+        FullScreenRenderTarget* target = nullptr;
+        bool imported = false;
+        
+        int firstPass = -1, lastPass = -1;
+    };
+    
+    class Pass
+    {
+    public :
+        std::string name;
+        std::vector<int> reads, writes;
+        RenderPassFunction execute;
+        bool culled = false;
+    };
+    
+    RenderTargetPool& pool;
+    
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    
+    void cullPasses();
+    void computeLifetimes();
+
+public :
+    RenderGraph(RenderTargetPool& pool): pool(pool) {}
+    
+    // resource handles, valid for this graph only
+    int createTarget(std::string name, const RenderTargetDescription& description);
+    // target is kept between frames by its owner; nullptr is the default framebuffer of the given size
+    int importTarget(std::string name, FullScreenRenderTarget* target, const RenderTargetDescription& description);
+    
+    // the first written target is bound before execute is called
+    void addPass(std::string name, std::vector<int> reads, std::vector<int> writes, RenderPassFunction execute);
+    
+    // during the passes using the resource only
+    FullScreenRenderTarget& getTarget(int resource);
+    
+    void execute();
+};
+
+}
+
+#endif // SGE_RENDER_GRAPH_H
@@ -0,0 +1,156 @@
+#include "RenderQueue.h"
+#include "GLUtils.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+const int PROGRAM_BITS = 8, TEXTURE_BITS = 16, MESH_BITS = 16, DEPTH_BITS = 22;
+
+template<class T>
+static uint64_t getDenseId(vector<T>& ids, T value, int bits)
+{
+    // a handful of distinct values per frame, linear search is fine
+    auto found = find(ids.begin(), ids.end(), value);
+    if (found != ids.end())
+        return (uint64_t)(found - ids.begin());
+    
+    verify(ids.size() < (1u << bits), "Render queue supports up to %d distinct values in a %d-bit key field.",
+           1 << bits, bits);
+    
+    ids.push_back(value);
+    return ids.size() - 1;
+}
+
+static int getProgramId(uint64_t key)
+{
+    return (int)((key >> (TEXTURE_BITS + MESH_BITS + DEPTH_BITS)) & ((1 << PROGRAM_BITS) - 1));
+}
+
+void RenderQueue::clear()
+{
+    items.clear();
+    entries.clear();
+    programIds.clear();
+    textureIds.clear();
+    meshIds.clear();
+    programUsesDrawUniforms.clear();
+}
+
+void RenderQueue::add(RenderPass pass, GLuint program, const GLSingleTextureMesh& mesh, const mat4& modelMatrix,
+                      ftype viewDepth, int lodLevel)
+{
+    ftype relativeDepth = glm::clamp((viewDepth - nearDepth) / (farDepth - nearDepth), 0.0, 1.0);
+    
+    uint64_t programId = getDenseId(programIds, program, PROGRAM_BITS);
+    if (programId == programUsesDrawUniforms.size())
+        programUsesDrawUniforms.push_back(usesDrawUniforms(program));
+    
+    uint64_t depth = (uint64_t)(relativeDepth * ((1 << DEPTH_BITS) - 1));
+    
+    uint64_t key = (uint64_t)pass;
+    key = (key << PROGRAM_BITS) | programId;
+    key = (key << TEXTURE_BITS) | getDenseId(textureIds, mesh.textureId, TEXTURE_BITS);
+    key = (key << MESH_BITS) | getDenseId(meshIds, &mesh, MESH_BITS);
+    key = (key << DEPTH_BITS) | depth;
+    
+    entries.push_back(SortEntry { key, (int)items.size() });
+    items.push_back(RenderItem { pass, program, &mesh, modelMatrix, lodLevel });
+}
+
+// least significant digit first, bytes which are the same in all keys are skipped
+void RenderQueue::radixSort()
+{
+    scratch.resize(entries.size());
+    
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        int counts[256] = {};
+        for (const SortEntry& entry: entries)
+            counts[(entry.key >> shift) & 0xFF]++;
+        
+        if (counts[(entries[0].key >> shift) & 0xFF] == (int)entries.size())
+            continue;
+        
+        int offsets[256];
+        int total = 0;
+        for (int digit = 0; digit < 256; digit++)
+        {
+            offsets[digit] = total;
+            total += counts[digit];
+        }
+        
+        for (const SortEntry& entry: entries)
+            scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+        
+        swap(entries, scratch);
+    }
+}
+
+void RenderQueue::submit(mat4 projectionViewMatrix)
+{
+    nDrawCalls = nProgramChanges = nTextureChanges = nMeshChanges = 0;
+    nTriangles = 0;
+    
+    if (entries.empty())
+        return;
+    
+    radixSort();
+    
+    // model matrices of the items drawn with uniform blocks, in the order of drawing
+    vector<size_t> drawUniformOffsets(entries.size());
+    drawUniforms.clear();
+    
+    for (int i = 0; i < (int)entries.size(); i++)
+    {
+        if (programUsesDrawUniforms[getProgramId(entries[i].key)])
+            drawUniformOffsets[i] = drawUniforms.add(items[entries[i].item].modelMatrix);
+    }
+    
+    drawUniforms.upload();
+    
+    const RenderItem* previous = nullptr;
+    glEnable(GL_TEXTURE_2D);
+    
+    for (int i = 0; i < (int)entries.size(); i++)
+    {
+        const RenderItem& item = items[entries[i].item];
+        const GLSingleTextureMesh& mesh = *item.mesh;
+        SDL_assert(mesh.gpuBuffers);
+        
+        if (!previous || previous->program != item.program)
+        {
+            glUseProgram(item.program);
+            nProgramChanges++;
+        }
+        
+        if (!previous || previous->mesh->textureId != mesh.textureId)
+        {
+            glBindTexture(mesh.textureTarget, mesh.textureId);
+            nTextureChanges++;
+        }
+        
+        if (!previous || previous->mesh != item.mesh)
+        {
+            glBindVertexArray(mesh.gpuBuffers->vertexArray);
+            nMeshChanges++;
+        }
+        
+        const LodIndexRanges& ranges = mesh.gpuBuffers->lodRanges;
+        int nIndices = ranges.getIndexCount(item.lodLevel);
+        
+        if (programUsesDrawUniforms[getProgramId(entries[i].key)])
+            drawUniforms.bind(drawUniformOffsets[i]);
+        else
+            glLoadMatrixd(glm::value_ptr(projectionViewMatrix * item.modelMatrix));
+        
+        glDrawElements(GL_TRIANGLES, nIndices, GL_UNSIGNED_INT, ranges.getIndexOffset(item.lodLevel));
+        nDrawCalls++;
+        nTriangles += nIndices / 3;
+        
+        previous = &item;
+    }
+    
+    glBindVertexArray(0);
+}
@@ -0,0 +1,75 @@
+#ifndef SGE_RENDER_QUEUE_H
+#define SGE_RENDER_QUEUE_H
+
+#include "Common.h"
+#include "UniformBuffers.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+class GLSingleTextureMesh;
+
+// passes are drawn in this order; there is no transparent geometry yet, a pass for it
+// would need the depth before the state in the key to be drawn back to front
+enum class RenderPass
+{
+    OPAQUE
+};
+
+class RenderItem
+{
+public :
+    RenderPass pass;
+    GLuint program;
+    const GLSingleTextureMesh* mesh;
+    mat4 modelMatrix;
+    int lodLevel;
+};
+
+// Draw items sorted by a 64-bit key, from the most significant bits:
+// pass (2) | program (8) | texture (16) | mesh (16) | view depth (22).
+// Programs, textures & meshes get dense per-frame ids in the order they are added,
+// state is only changed between items which differ in it. Legacy programs get the matrix through
+// glLoadMatrixd, programs with a DrawUniforms block through one uniform buffer for the whole queue.
+class RenderQueue
+{
+    struct SortEntry
+    {
+        uint64_t key;
+        int item;
+    };
+    
+    std::vector<RenderItem> items;
+    std::vector<SortEntry> entries, scratch;
+    
+    std::vector<GLuint> programIds, textureIds;
+    std::vector<const GLSingleTextureMesh*> meshIds;
+    
+    // by program id: the model matrix goes to drawUniforms instead of the modelview matrix
+    std::vector<bool> programUsesDrawUniforms;
+    DrawUniformBuffer drawUniforms;
+    
+    void radixSort();
+
+public :
+    // view depth range mapped to the depth bits
+    ftype nearDepth = 0.1, farDepth = 1e3;
+    
+    // statistics of the last submit
+    int nDrawCalls = 0, nProgramChanges = 0, nTextureChanges = 0, nMeshChanges = 0;
+    int nTriangles = 0;
+    
+    void clear();
+    void add(RenderPass pass, GLuint program, const GLSingleTextureMesh& mesh, const mat4& modelMatrix, ftype viewDepth,
+             int lodLevel = 0);
+    
+    // sorts & draws everything, leaves the last program bound; the FrameUniformBuffer must be up to date
+    void submit(mat4 projectionViewMatrix);
+};
+
+}
+
+#endif // SGE_RENDER_QUEUE_H
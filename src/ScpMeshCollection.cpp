@@ -75,14 +75,22 @@ GLSimpleMesh createCubeMesh(GLuint textureId, ftype textureMaxX, ftype textureMa
                     cube.faces.push_back(face);
                 }
     
-    cube.decomposeIntoSingleTextureMeshes();
     return cube;
 }
 
 void ScpMeshCollection::loadMeshes()
 {
-    const Texture& cubeTexture = TextureManager::instance().retrieveTexture("verticals.jpg");
-    cubeMesh = createCubeMesh(cubeTexture.openglId, cubeTexture.getMaxU(), cubeTexture.getMaxV());
+    if (geometryOnly)
+        cubeMesh = createCubeMesh(0, 1, 1);
+    else
+    {
+        const Texture& cubeTexture = TextureManager::instance().retrieveTexture("verticals.jpg");
+        cubeMesh = createCubeMesh(cubeTexture.openglId, cubeTexture.getMaxU(), cubeTexture.getMaxV());
+    }
+    
+    beginMesh(&cubeMesh);
+    finishMesh();
+    cubeMesh.makeOccluder();
     
     createStaircaseMesh();
     createPlaneMesh();
@@ -123,7 +131,7 @@ void StateMachineMeshEditor::addQuad(vec3 a, vec3 b, ftype textureScale)
     
     if (!smartWrapping)
         texCoords({ { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } });
-    else
+    else if (currentTexture)
     {
         SDL_assert(weakEq(currentTexture->getMaxU(), 1));
         SDL_assert(weakEq(currentTexture->getMaxV(), 1));
@@ -159,6 +167,9 @@ void ScpMeshCollection::createStaircaseMesh()
     
     beginMesh(&staircase);
     
+    // entrance doorway, the previous module ends here
+    markPortal("entrance", { { -0.5, 0, 0 }, { 0.5, 0, 0 }, { 0.5, 3, 0 }, { -0.5, 3, 0 } });
+    
     // transition mesh
     
     //translate(0, -1, 0);
@@ -233,8 +244,10 @@ void ScpMeshCollection::createStaircaseMesh()
     
     translate(0, 0, -3);
     markCurrentPosition("continuation-point");
+    markPortal("exit", { { 0.5, 0, 0 }, { -0.5, 0, 0 }, { -0.5, 3, 0 }, { 0.5, 3, 0 } });
     
     finishMesh();
+    staircase.makeOccluder();
 }
 
 GLSimpleMesh ScpMeshCollection::createStaircase(ftype horizOne, ftype vertOne, ftype horizTwo, ftype vertTwo, int nSteps)
@@ -268,6 +281,7 @@ void ScpMeshCollection::createPlaneMesh()
     addQuad({ -5, 0, -5 }, { 5, 0, 5 }, 1.0);
     
     finishMesh();
+    plane.makeOccluder();
 }
 
 template<class T>
@@ -528,5 +542,8 @@ GLSimpleMesh sge::loadColladaMesh(const char* colladaFileName)
     //printf("Done...\n");
     //fflush(stdout);
     
+    mesh.computeBounds();
+    mesh.generateLods();
+    mesh.buildTextureArrayMesh();
     return mesh;
 }
@@ -76,6 +76,9 @@ protected :
     
     void setTexture(std::string name)
     {
+        if (geometryOnly)
+            return;
+        
         currentTexture = &TextureManager::instance().retrieveTexture(name);
         currentFace.textureId = currentTexture->openglId;
     }
@@ -93,8 +96,11 @@ protected :
     {
         for (auto tc: texCoords)
         {
-            tc.x = tc.x * currentTexture->getMaxU();
-            tc.y = tc.y * currentTexture->getMaxV();
+            if (currentTexture)
+            {
+                tc.x = tc.x * currentTexture->getMaxU();
+                tc.y = tc.y * currentTexture->getMaxV();
+            }
             currentFace.textureCoords.push_back(tc);
         }
     }
@@ -134,9 +140,34 @@ protected :
         currentMesh->markers.push_back(marker);
     }
     
+    // doorway of a room, see SimpleWorldContainer::buildCells; matching portals of two rooms must coincide
+    void markPortal(std::string name, const std::vector<vec3>& polygon)
+    {
+        const mat4& currentMatrix = transformStack.back();
+        
+        MeshMarker marker;
+        marker.name = name;
+        
+        for (const vec3& point: polygon)
+        {
+            marker.polygon.push_back(vec3(currentMatrix * vec4(point, 1)));
+            marker.position += marker.polygon.back() / (ftype)polygon.size();
+        }
+        
+        // vertices go counter-clockwise as seen from outside, so the normal looks out of the room
+        SDL_assert(polygon.size() >= 3);
+        vec3 firstEdge = marker.polygon[1] - marker.polygon[0], secondEdge = marker.polygon[2] - marker.polygon[0];
+        marker.direction = glm::normalize(glm::cross(firstEdge, secondEdge));
+        
+        currentMesh->markers.push_back(marker);
+    }
+    
     void finishMesh()
     {
-        currentMesh->decomposeIntoSingleTextureMeshes();
+        if (geometryOnly)
+            currentMesh->computeBounds();
+        else
+            currentMesh->decomposeIntoSingleTextureMeshes();
     }
     
     // pushMatrix / popMatrix
@@ -146,12 +177,16 @@ protected :
     // texCoords ( { }, { }, { } )
     // makeClimber, makeCollisionInactive, setWalkingSpeed
     // finishFace
+    // markCurrentPosition, markPortal
     
     // handy quad adding functions for quads parallel to XY, YZ or ZX
     
     void addQuad(vec3 a, vec3 b, ftype textureScale = 0.0);
     
 public :
+    // faces & markers only: no textures are loaded & nothing is uploaded, so no OpenGL context is needed
+    bool geometryOnly = false;
+    
     StateMachineMeshEditor(): currentTexture(nullptr) {}
 };
 
@@ -47,12 +47,23 @@ GLuint loadGlShader(const char* fileName, GLenum glShaderType, const char* shade
 {
     string contents = getFileContents(fileName);
     
+    // #version must come first, so the prefix goes right after it
+    string versionLine;
+    if (contents.compare(0, 8, "#version") == 0)
+    {
+        size_t lineEnd = contents.find('\n');
+        verify(lineEnd != string::npos, "Shader '%s' has nothing but a #version line.", fileName);
+        
+        versionLine = contents.substr(0, lineEnd + 1);
+        contents.erase(0, lineEnd + 1);
+    }
+    
     GLuint shader = glCreateShader(glShaderType);
     
-    const char* sections[] = { shaderCodePrefix, contents.c_str() };
-    const GLint lengths[] = { (GLint)strlen(shaderCodePrefix), (GLint)contents.length() };
+    const char* sections[] = { versionLine.c_str(), shaderCodePrefix, contents.c_str() };
+    const GLint lengths[] = { (GLint)versionLine.length(), (GLint)strlen(shaderCodePrefix), (GLint)contents.length() };
     
-    glShaderSource(shader, 2, sections, lengths);
+    glShaderSource(shader, 3, sections, lengths);
 
     glCompileShader(shader);
     
@@ -70,3 +81,51 @@ GLuint loadGlShader(const char* fileName, GLenum glShaderType, const char* shade
     
     return shader;
 }
+
+static GLuint linkGlProgram(const vector<GLuint>& shaders, const vector<string>& attributeNames, const char* description)
+{
+    GLuint program = glCreateProgram();
+    for (GLuint shader: shaders)
+        glAttachShader(program, shader);
+    
+    for (unsigned i = 0; i < attributeNames.size(); i++)
+        glBindAttribLocation(program, i, attributeNames[i].c_str());
+    
+    glLinkProgram(program);
+    
+    // flagged for deletion, actually deleted with the program
+    for (GLuint shader: shaders)
+        glDeleteShader(shader);
+    
+    GLint linkOk = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linkOk);
+    if (!linkOk)
+        critical_error("Failed to link shader program (%s): %s", description, getShaderOrProgramLog(program).c_str());
+    
+    return program;
+}
+
+GLuint createGlProgram(const char* vertexShaderFileName, const char* fragmentShaderFileName, const char* shaderCodePrefix,
+                       const vector<string>& attributeNames)
+{
+    vector<GLuint> shaders;
+    shaders.push_back(loadGlShader(vertexShaderFileName, GL_VERTEX_SHADER, shaderCodePrefix));
+    shaders.push_back(loadGlShader(fragmentShaderFileName, GL_FRAGMENT_SHADER, shaderCodePrefix));
+    
+    string description = string("'") + vertexShaderFileName + "', '" + fragmentShaderFileName + "'";
+    return linkGlProgram(shaders, attributeNames, description.c_str());
+}
+
+GLuint createGlProgramWithGeometryShader(const char* vertexShaderFileName, const char* geometryShaderFileName,
+                                         const char* fragmentShaderFileName, const char* shaderCodePrefix,
+                                         const vector<string>& attributeNames)
+{
+    vector<GLuint> shaders;
+    shaders.push_back(loadGlShader(vertexShaderFileName, GL_VERTEX_SHADER, shaderCodePrefix));
+    shaders.push_back(loadGlShader(geometryShaderFileName, GL_GEOMETRY_SHADER, shaderCodePrefix));
+    shaders.push_back(loadGlShader(fragmentShaderFileName, GL_FRAGMENT_SHADER, shaderCodePrefix));
+    
+    string description = string("'") + vertexShaderFileName + "', '" + geometryShaderFileName + "', '" +
+                         fragmentShaderFileName + "'";
+    return linkGlProgram(shaders, attributeNames, description.c_str());
+}
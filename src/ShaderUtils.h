@@ -4,11 +4,23 @@
 #include "Common.h"
 
 #include <string>
+#include <vector>
 
 std::string getFileContents(const char* fileName);
 
 std::string getShaderOrProgramLog(GLuint shaderOrProgramObject);
 
+// the prefix (#defines) is inserted after the #version line of the file, if there is one
 GLuint loadGlShader(const char* fileName, GLenum glShaderType, const char* shaderCodePrefix);
 
+// shaders are only owned by the returned program, deleting the program frees them;
+// attributeNames are bound to locations 0, 1, ... in the given order before linking
+GLuint createGlProgram(const char* vertexShaderFileName, const char* fragmentShaderFileName, const char* shaderCodePrefix,
+                       const std::vector<std::string>& attributeNames = std::vector<std::string>());
+
+// the same with a geometry shader in between; geometry shaders need GLSL 1.50, so the prefix should start with #version
+GLuint createGlProgramWithGeometryShader(const char* vertexShaderFileName, const char* geometryShaderFileName,
+                                         const char* fragmentShaderFileName, const char* shaderCodePrefix,
+                                         const std::vector<std::string>& attributeNames = std::vector<std::string>());
+
 #endif // SGE_SHADER_UTILS_H
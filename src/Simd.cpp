@@ -0,0 +1,55 @@
+#include "Simd.h"
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace sge;
+
+static SimdLevel detectSimdLevel()
+{
+    SimdLevel level = SimdLevel::SCALAR;
+    
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    
+    if (__builtin_cpu_supports("sse2"))
+        level = SimdLevel::SSE;
+    
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        level = SimdLevel::AVX2;
+#endif
+
+    const char* requested = getenv("SGE_SIMD");
+    if (requested)
+    {
+        SimdLevel limit = SimdLevel::AVX2;
+        
+        if (!strcmp(requested, "scalar"))
+            limit = SimdLevel::SCALAR;
+        else if (!strcmp(requested, "sse"))
+            limit = SimdLevel::SSE;
+        
+        if ((int)limit < (int)level)
+            level = limit;
+    }
+    
+    return level;
+}
+
+SimdLevel sge::getSimdLevel()
+{
+    static SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+const char* sge::getSimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+        case SimdLevel::SCALAR: return "scalar";
+        case SimdLevel::SSE: return "SSE";
+        case SimdLevel::AVX2: return "AVX2";
+        default: unreachable();
+    }
+}
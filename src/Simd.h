@@ -0,0 +1,23 @@
+#ifndef SGE_SIMD_H
+#define SGE_SIMD_H
+
+#include "Common.h"
+
+namespace sge
+{
+
+// instruction sets the vectorized kernels are compiled for, in order of preference
+enum class SimdLevel
+{
+    SCALAR,
+    SSE,
+    AVX2
+};
+
+// detected on the first call from cpuid, SGE_SIMD=scalar|sse|avx2 can only lower the result
+SimdLevel getSimdLevel();
+const char* getSimdLevelName(SimdLevel level);
+
+}
+
+#endif // SGE_SIMD_H
@@ -0,0 +1,153 @@
+#include "SkinningKernels.h"
+#include "Simd.h"
+
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SGE_X86_KERNELS
+#endif
+
+using namespace std;
+using namespace sge;
+
+void PositionArrays::resize(int n)
+{
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+}
+
+typedef void (*SkinningKernel)(const PackedSkin& skin, const float* palette, PositionArrays& output, int begin, int end);
+
+static void skinPositionsScalar(const PackedSkin& skin, const float* palette, PositionArrays& output, int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        float x = skin.bindPositions.x[i], y = skin.bindPositions.y[i], z = skin.bindPositions.z[i];
+        float rx = 0, ry = 0, rz = 0;
+        
+        for (int k = 0; k < MAX_PACKED_INFLUENCES; k++)
+        {
+            const float* m = palette + skin.jointIndices[i * MAX_PACKED_INFLUENCES + k] * PALETTE_MATRIX_FLOATS;
+            float w = skin.jointWeights[i * MAX_PACKED_INFLUENCES + k];
+            
+            rx += w * (m[0] * x + m[4] * y + m[8] * z + m[12]);
+            ry += w * (m[1] * x + m[5] * y + m[9] * z + m[13]);
+            rz += w * (m[2] * x + m[6] * y + m[10] * z + m[14]);
+        }
+        
+        output.x[i] = rx;
+        output.y[i] = ry;
+        output.z[i] = rz;
+    }
+}
+
+#ifdef SGE_X86_KERNELS
+
+// Both vectorized kernels skin one vertex per register (xyzw lanes), blending the transformed
+// positions of all influences, and transpose groups of four vertices back into the arrays.
+
+static inline __m128 skinVertexSse(const PackedSkin& skin, const float* palette, int i)
+{
+    __m128 x = _mm_set1_ps(skin.bindPositions.x[i]);
+    __m128 y = _mm_set1_ps(skin.bindPositions.y[i]);
+    __m128 z = _mm_set1_ps(skin.bindPositions.z[i]);
+    
+    const uint16_t* joints = &skin.jointIndices[i * MAX_PACKED_INFLUENCES];
+    const float* weights = &skin.jointWeights[i * MAX_PACKED_INFLUENCES];
+    
+    __m128 result = _mm_setzero_ps();
+    
+    for (int k = 0; k < MAX_PACKED_INFLUENCES; k++)
+    {
+        const float* m = palette + joints[k] * PALETTE_MATRIX_FLOATS;
+        
+        __m128 transformed = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m), x), _mm_mul_ps(_mm_loadu_ps(m + 4), y)),
+                                        _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(m + 8), z), _mm_loadu_ps(m + 12)));
+        result = _mm_add_ps(result, _mm_mul_ps(transformed, _mm_set1_ps(weights[k])));
+    }
+    
+    return result;
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m128 skinVertexAvx2(const PackedSkin& skin, const float* palette, int i)
+{
+    // columns 0|1 and 2|3 of a matrix are multiplied by x|y and z|1 at once
+    __m256 xy = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(skin.bindPositions.x[i])),
+                                     _mm_set1_ps(skin.bindPositions.y[i]), 1);
+    __m256 z1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(skin.bindPositions.z[i])),
+                                     _mm_set1_ps(1.0f), 1);
+    
+    const uint16_t* joints = &skin.jointIndices[i * MAX_PACKED_INFLUENCES];
+    const float* weights = &skin.jointWeights[i * MAX_PACKED_INFLUENCES];
+    
+    __m256 result = _mm256_setzero_ps();
+    
+    for (int k = 0; k < MAX_PACKED_INFLUENCES; k++)
+    {
+        const float* m = palette + joints[k] * PALETTE_MATRIX_FLOATS;
+        
+        __m256 transformed = _mm256_fmadd_ps(_mm256_loadu_ps(m), xy, _mm256_mul_ps(_mm256_loadu_ps(m + 8), z1));
+        result = _mm256_fmadd_ps(transformed, _mm256_set1_ps(weights[k]), result);
+    }
+    
+    return _mm_add_ps(_mm256_castps256_ps128(result), _mm256_extractf128_ps(result, 1));
+}
+
+#define SGE_DEFINE_SKINNING_KERNEL(name, skinVertex, attributes) \
+    attributes \
+    static void name(const PackedSkin& skin, const float* palette, PositionArrays& output, int begin, int end) \
+    { \
+        int i = begin; \
+        \
+        for (; i + 4 <= end; i += 4) \
+        { \
+            __m128 v0 = skinVertex(skin, palette, i + 0); \
+            __m128 v1 = skinVertex(skin, palette, i + 1); \
+            __m128 v2 = skinVertex(skin, palette, i + 2); \
+            __m128 v3 = skinVertex(skin, palette, i + 3); \
+            _MM_TRANSPOSE4_PS(v0, v1, v2, v3); \
+            \
+            _mm_storeu_ps(&output.x[i], v0); \
+            _mm_storeu_ps(&output.y[i], v1); \
+            _mm_storeu_ps(&output.z[i], v2); \
+        } \
+        \
+        skinPositionsScalar(skin, palette, output, i, end); \
+    }
+
+SGE_DEFINE_SKINNING_KERNEL(skinPositionsSse, skinVertexSse, )
+SGE_DEFINE_SKINNING_KERNEL(skinPositionsAvx2, skinVertexAvx2, __attribute__((target("avx2,fma"))))
+
+#undef SGE_DEFINE_SKINNING_KERNEL
+
+#endif // SGE_X86_KERNELS
+
+static SkinningKernel selectSkinningKernel()
+{
+    SimdLevel level = getSimdLevel();
+    printf("Skinning kernel: %s\n", getSimdLevelName(level));
+    
+    switch (level)
+    {
+#ifdef SGE_X86_KERNELS
+        case SimdLevel::AVX2: return skinPositionsAvx2;
+        case SimdLevel::SSE: return skinPositionsSse;
+#else
+        case SimdLevel::AVX2:
+        case SimdLevel::SSE:
+#endif
+        case SimdLevel::SCALAR: return skinPositionsScalar;
+        default: unreachable();
+    }
+}
+
+void sge::skinPositions(const PackedSkin& skin, const float* palette, PositionArrays& output, int begin, int end)
+{
+    SDL_assert(0 <= begin && begin <= end && end <= skin.size() && output.size() == skin.size());
+    
+    static SkinningKernel kernel = selectSkinningKernel();
+    kernel(skin, palette, output, begin, end);
+}
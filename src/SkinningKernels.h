@@ -0,0 +1,45 @@
+#ifndef SGE_SKINNING_KERNELS_H
+#define SGE_SKINNING_KERNELS_H
+
+#include "Common.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+// number of influences per vertex in fixed-width skinning layouts
+const int MAX_PACKED_INFLUENCES = 4;
+
+// floats per joint in a skinning palette, a column-major 4x4 matrix
+const int PALETTE_MATRIX_FLOATS = 16;
+
+class PositionArrays
+{
+public :
+    std::vector<float> x, y, z;
+    
+    void resize(int n);
+    int size() const { return (int)x.size(); }
+};
+
+// Bind pose of a skinned mesh in the layout the kernels read:
+// MAX_PACKED_INFLUENCES joint indices & normalized weights per vertex, unused slots have zero weight.
+class PackedSkin
+{
+public :
+    PositionArrays bindPositions;
+    std::vector<uint16_t> jointIndices;
+    std::vector<float> jointWeights;
+    
+    int size() const { return bindPositions.size(); }
+};
+
+// skins vertices [begin, end) of the skin, output must already be sized;
+// the implementation is picked once by getSimdLevel
+void skinPositions(const PackedSkin& skin, const float* palette, PositionArrays& output, int begin, int end);
+
+}
+
+#endif // SGE_SKINNING_KERNELS_H
@@ -0,0 +1,186 @@
+#include "StreamingBuffer.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+StreamingBuffer& StreamingBuffer::instance()
+{
+    static StreamingBuffer instance;
+    return instance;
+}
+
+void StreamingBuffer::create(size_t newRegionSize)
+{
+    regionSize = newRegionSize;
+    persistent = SDL_GL_ExtensionSupported("GL_ARB_buffer_storage") == SDL_TRUE;
+    
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    
+    if (persistent)
+    {
+        // coherent: writes are seen by the GPU without explicit flushes
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        size_t size = regionSize * STREAMING_BUFFER_FRAMES;
+        
+        glBufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+        mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        verify(mapped, "Failed to map a streaming buffer of %d bytes.", (int)size);
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+        staging.resize(regionSize);
+    }
+    
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    region = 0;
+    writeOffset = flushedOffset = 0;
+}
+
+void StreamingBuffer::release()
+{
+    for (GLsync& fence: fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+        
+        fence = nullptr;
+    }
+    
+    if (buffer)
+    {
+        // deleting a buffer unmaps it
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+    
+    mapped = nullptr;
+    vector<uint8_t>().swap(staging);
+}
+
+void StreamingBuffer::destroy()
+{
+    release();
+    
+    for (GLuint retired: retiredBuffers)
+        glDeleteBuffers(1, &retired);
+    
+    retiredBuffers.clear();
+    regionSize = 0;
+}
+
+void StreamingBuffer::beginFrame()
+{
+    // draws of the previous frame have been issued, so buffers they use can go
+    for (GLuint retired: retiredBuffers)
+        glDeleteBuffers(1, &retired);
+    
+    retiredBuffers.clear();
+    
+    if (!buffer)
+        create(max(regionSize, STREAMING_BUFFER_DEFAULT_REGION_SIZE));
+    
+    writeOffset = flushedOffset = 0;
+    
+    if (!persistent)
+    {
+        // orphaning: the driver gives a new store & keeps the old one until the GPU is done with it
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, regionSize, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+    }
+    
+    region = (region + 1) % STREAMING_BUFFER_FRAMES;
+    GLsync& fence = fences[region];
+    
+    if (fence)
+    {
+        GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        
+        while (true)
+        {
+            // one second, then the wait is repeated
+            GLenum result = glClientWaitSync(fence, waitFlags, 1000 * 1000 * 1000);
+            verify(result != GL_WAIT_FAILED, "Waiting for a streaming buffer fence failed.");
+            
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+                break;
+            
+            waitFlags = 0;
+        }
+        
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+void StreamingBuffer::endFrame()
+{
+    flush();
+    
+    if (persistent && buffer)
+    {
+        SDL_assert(!fences[region]);
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+StreamingAllocation StreamingBuffer::allocate(size_t size, size_t alignment)
+{
+    if (!buffer)
+        beginFrame();
+    
+    size_t start = (writeOffset + alignment - 1) / alignment * alignment;
+    
+    if (start + size > regionSize)
+    {
+        // earlier allocations of this frame keep using the old buffer until the frame is over
+        flush();
+        
+        GLuint oldBuffer = buffer;
+        buffer = 0;
+        
+        size_t newRegionSize = regionSize * 2;
+        while (newRegionSize < size)
+            newRegionSize *= 2;
+        
+        // nothing is written to the old buffer anymore, its regions need no waiting
+        for (GLsync& fence: fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            
+            fence = nullptr;
+        }
+        
+        retiredBuffers.push_back(oldBuffer);
+        create(newRegionSize);
+        
+        start = 0;
+    }
+    
+    StreamingAllocation allocation;
+    allocation.buffer = buffer;
+    allocation.offset = getRegionStart() + start;
+    allocation.data = persistent ? mapped + allocation.offset : staging.data() + start;
+    
+    writeOffset = start + size;
+    return allocation;
+}
+
+void StreamingBuffer::flush()
+{
+    if (persistent || writeOffset == flushedOffset)
+        return;
+    
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, flushedOffset, writeOffset - flushedOffset, staging.data() + flushedOffset);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    flushedOffset = writeOffset;
+}
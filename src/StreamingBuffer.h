@@ -0,0 +1,75 @@
+#ifndef SGE_STREAMING_BUFFER_H
+#define SGE_STREAMING_BUFFER_H
+
+#include "Common.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+// frames the CPU may be ahead of the GPU, every one has its own region of the ring
+const int STREAMING_BUFFER_FRAMES = 3;
+
+const size_t STREAMING_BUFFER_DEFAULT_REGION_SIZE = 1 << 20;
+
+class StreamingAllocation
+{
+public :
+    // write here, then flush the buffer before drawing
+    void* data = nullptr;
+    
+    // bind buffer & use offset as the attribute pointer
+    GLuint buffer = 0;
+    size_t offset = 0;
+};
+
+// Per-frame vertex data written once by the CPU straight into GPU visible memory.
+// With GL_ARB_buffer_storage the buffer is mapped persistently & split into STREAMING_BUFFER_FRAMES regions,
+// a frame waits for the fence of the frame which used its region before, which is normally long done.
+// Otherwise the whole buffer is one region orphaned every frame, data is staged & sent by flush.
+class StreamingBuffer
+{
+    GLuint buffer = 0;
+    size_t regionSize = 0;
+    bool persistent = false;
+    
+    uint8_t* mapped = nullptr;
+    std::vector<uint8_t> staging;
+    
+    int region = 0;
+    size_t writeOffset = 0, flushedOffset = 0;
+    GLsync fences[STREAMING_BUFFER_FRAMES] = {};
+    
+    // replaced by bigger ones during this frame, deleted when it is over
+    std::vector<GLuint> retiredBuffers;
+    
+    void create(size_t newRegionSize);
+    void release();
+    size_t getRegionStart() const { return persistent ? region * regionSize : 0; }
+
+public :
+    StreamingBuffer() {}
+    StreamingBuffer(const StreamingBuffer&) = delete;
+    ~StreamingBuffer() { destroy(); }
+    
+    // the buffer of per-frame vertex data, GameController begins & ends its frames
+    static StreamingBuffer& instance();
+    
+    void beginFrame();
+    void endFrame();
+    
+    // must be written before the next allocation; a region which is too small is replaced
+    // by one twice as big, the draws of earlier allocations still read the old one
+    StreamingAllocation allocate(size_t size, size_t alignment = 16);
+    
+    // makes everything written since the last flush visible to the draws issued after it
+    void flush();
+    
+    void destroy();
+};
+
+}
+
+#endif // SGE_STREAMING_BUFFER_H
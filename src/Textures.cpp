@@ -74,6 +74,68 @@ const Texture& TextureManager::retrieveTexture(string fileName)
     return *textureByName[fileName];
 }
 
+// pixels are read back from the loaded textures, textures in an array must all have the same size
+static unique_ptr<TextureArray> createTextureArray(const vector<GLuint>& layerTextures)
+{
+    unique_ptr<TextureArray> textureArrayPtr(new TextureArray);
+    TextureArray& textureArray = *textureArrayPtr;
+    
+    textureArray.layerTextures = layerTextures;
+    
+    for (int layer = 0; layer < (int)layerTextures.size(); layer++)
+    {
+        GLint width = 0, height = 0;
+        
+        glBindTexture(GL_TEXTURE_2D, layerTextures[layer]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        
+        if (layer == 0)
+        {
+            textureArray.width = width;
+            textureArray.height = height;
+        }
+        else if (width != textureArray.width || height != textureArray.height)
+        {
+            glBindTexture(GL_TEXTURE_2D, 0);
+            return nullptr;
+        }
+    }
+    
+    vector<GLubyte> pixels((size_t)textureArray.width * textureArray.height * 4);
+    
+    glGenTextures(1, &textureArray.openglId);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, textureArray.openglId);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, textureArray.width, textureArray.height, (GLsizei)layerTextures.size(),
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    
+    for (int layer = 0; layer < (int)layerTextures.size(); layer++)
+    {
+        glBindTexture(GL_TEXTURE_2D, layerTextures[layer]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, textureArray.width, textureArray.height, 1,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    }
+    
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    
+    return textureArrayPtr;
+}
+
+const TextureArray* TextureManager::retrieveTextureArray(const vector<GLuint>& layerTextures)
+{
+    auto found = textureArrayByLayers.find(layerTextures);
+    if (found != textureArrayByLayers.end())
+        return found->second.get();
+    
+    // arrays which can't be made are remembered as well
+    textureArrayByLayers[layerTextures] = createTextureArray(layerTextures);
+    return textureArrayByLayers[layerTextures].get();
+}
+
 TextureManager& TextureManager::instance()
 {
     static TextureManager instance;
@@ -6,6 +6,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace sge
 {
@@ -31,9 +32,29 @@ public :
     ftype getMaxV() const { return originalHeight / (ftype)extendedHeight; }
 };
 
+// GL_TEXTURE_2D_ARRAY with a copy of a texture of the same size in every layer
+class TextureArray
+{
+public :
+    GLuint openglId;
+    int width, height;
+    
+    // texture copied into every layer
+    std::vector<GLuint> layerTextures;
+    
+    TextureArray(): openglId(0), width(0), height(0) {}
+    TextureArray(const TextureArray& t) = delete;
+    
+    ~TextureArray()
+    {
+        glDeleteTextures(1, &openglId);
+    }
+};
+
 class TextureManager
 {
     std::map< std::string, std::unique_ptr<Texture> > textureByName;
+    std::map< std::vector<GLuint>, std::unique_ptr<TextureArray> > textureArrayByLayers;
     
     TextureManager() {}
 public :
@@ -41,6 +62,9 @@ public :
     static TextureManager& instance();
     
     const Texture& retrieveTexture(std::string fileName);
+    
+    // the same layers share one array; nullptr if the textures differ in size
+    const TextureArray* retrieveTextureArray(const std::vector<GLuint>& layerTextures);
 };
 
 }
@@ -0,0 +1,109 @@
+#include "UniformBuffers.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+const vector<string>& sge::getVertexAttributeNames()
+{
+    static const vector<string> names { "vertexPosition", "vertexTextureCoords", "instanceModelMatrix" };
+    return names;
+}
+
+void sge::bindUniformBlocks(GLuint program)
+{
+    GLuint frameBlock = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (frameBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, frameBlock, FRAME_UNIFORMS_BINDING);
+    
+    GLuint drawBlock = glGetUniformBlockIndex(program, "DrawUniforms");
+    if (drawBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, drawBlock, DRAW_UNIFORMS_BINDING);
+}
+
+bool sge::usesDrawUniforms(GLuint program)
+{
+    return glGetUniformBlockIndex(program, "DrawUniforms") != GL_INVALID_INDEX;
+}
+
+void FrameUniformBuffer::update(const mat4& projectionMatrix, const mat4& viewMatrix)
+{
+    uniforms.projectionViewMatrix = glm::mat4(projectionMatrix * viewMatrix);
+    uniforms.viewMatrix = glm::mat4(viewMatrix);
+    uniforms.projectionMatrix = glm::mat4(projectionMatrix);
+    
+    if (!buffer)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    }
+    else
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer);
+}
+
+void FrameUniformBuffer::destroy()
+{
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+    
+    buffer = 0;
+}
+
+size_t DrawUniformBuffer::add(const mat4& modelMatrix)
+{
+    if (!blockStride)
+    {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = max(alignment, 1);
+        
+        blockStride = (sizeof(DrawUniforms) + alignment - 1) / alignment * alignment;
+    }
+    
+    DrawUniforms block;
+    block.modelMatrix = glm::mat4(modelMatrix);
+    
+    size_t offset = contents.size();
+    contents.resize(offset + blockStride);
+    memcpy(contents.data() + offset, &block, sizeof(DrawUniforms));
+    
+    return offset;
+}
+
+void DrawUniformBuffer::upload()
+{
+    if (contents.empty())
+        return;
+    
+    if (!buffer)
+        glGenBuffers(1, &buffer);
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    // a new store every time, the draws of the previous upload may still be reading the old one
+    glBufferData(GL_UNIFORM_BUFFER, contents.size(), contents.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void DrawUniformBuffer::bind(size_t offset) const
+{
+    SDL_assert(buffer && offset + sizeof(DrawUniforms) <= contents.size());
+    glBindBufferRange(GL_UNIFORM_BUFFER, DRAW_UNIFORMS_BINDING, buffer, (GLintptr)offset, sizeof(DrawUniforms));
+}
+
+void DrawUniformBuffer::destroy()
+{
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+    
+    buffer = 0;
+    blockStride = 0;
+    contents.clear();
+}
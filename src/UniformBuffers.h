@@ -0,0 +1,85 @@
+#ifndef SGE_UNIFORM_BUFFERS_H
+#define SGE_UNIFORM_BUFFERS_H
+
+#include "Common.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace sge
+{
+
+// generic attribute locations of GLSingleTextureMesh vertex arrays & instanced draws;
+// instance matrices take four locations starting at INSTANCE_MATRIX_ATTRIBUTE
+const GLuint POSITION_ATTRIBUTE = 0;
+const GLuint TEXTURE_COORDS_ATTRIBUTE = 1;
+const GLuint INSTANCE_MATRIX_ATTRIBUTE = 2;
+
+// uniform buffer binding points, JOINT_PALETTE_BINDING is 0
+const GLuint FRAME_UNIFORMS_BINDING = 1;
+const GLuint DRAW_UNIFORMS_BINDING = 2;
+
+// attribute names in the order of the locations above, for createGlProgram
+const std::vector<std::string>& getVertexAttributeNames();
+
+// connects the FrameUniforms & DrawUniforms blocks of the program to their binding points, if it has them
+void bindUniformBlocks(GLuint program);
+
+// programs with a DrawUniforms block take the model matrix from it instead of the modelview matrix
+bool usesDrawUniforms(GLuint program);
+
+// std140 layout of the FrameUniforms block in core-vertex-shader.glsl
+class FrameUniforms
+{
+public :
+    glm::mat4 projectionViewMatrix;
+    glm::mat4 viewMatrix;
+    glm::mat4 projectionMatrix;
+};
+
+// std140 layout of the DrawUniforms block in core-vertex-shader.glsl
+class DrawUniforms
+{
+public :
+    glm::mat4 modelMatrix;
+};
+
+// View & projection, converted to floats & uploaded once per frame.
+class FrameUniformBuffer
+{
+    GLuint buffer = 0;
+
+public :
+    FrameUniforms uniforms;
+    
+    // uploads & binds to FRAME_UNIFORMS_BINDING
+    void update(const mat4& projectionMatrix, const mat4& viewMatrix);
+    void destroy();
+};
+
+// Per-draw blocks of a whole frame in one buffer, every draw binds its range.
+// The buffer is orphaned on every upload, so the driver does not wait for the previous frame.
+class DrawUniformBuffer
+{
+    GLuint buffer = 0;
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT rounded up to the block size
+    size_t blockStride = 0;
+    std::vector<uint8_t> contents;
+
+public :
+    void clear() { contents.clear(); }
+    
+    // returns the offset of the block to pass to bind
+    size_t add(const mat4& modelMatrix);
+    
+    // everything added since clear
+    void upload();
+    void bind(size_t offset) const;
+    
+    void destroy();
+};
+
+}
+
+#endif // SGE_UNIFORM_BUFFERS_H
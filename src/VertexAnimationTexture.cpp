@@ -0,0 +1,213 @@
+#include "VertexAnimationTexture.h"
+#include "StreamingBuffer.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+// fixed row length, a whole frame of a big mesh would not fit into a single texture row
+const int VAT_TEXTURE_WIDTH = 1024;
+
+void VertexAnimationTexture::bake(Mesh& mesh, ftype framesPerSecond)
+{
+    destroy();
+    
+    verify(!mesh.animationChannels.empty(), "Only animated meshes can be baked into a vertex animation texture.");
+    verify(framesPerSecond > 0, "Vertex animation texture frame rate must be positive.");
+    
+    mesh.applyBindShapeMatrix();
+    
+    ftype startTime = mesh.getAnimationStartTime();
+    ftype duration = mesh.getAnimationEndTime() - startTime;
+    
+    frameRate = framesPerSecond;
+    nVertices = (int)mesh.vertices.size();
+    nFrames = max(1, (int)ceil(duration * frameRate));
+    
+    long long nTexels = (long long)nVertices * nFrames;
+    textureWidth = VAT_TEXTURE_WIDTH;
+    textureHeight = (int)((nTexels + textureWidth - 1) / textureWidth);
+    
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    verify(textureHeight <= maxTextureSize,
+           "Vertex animation texture needs %d rows, only %d are supported (%d vertices, %d frames).",
+           textureHeight, maxTextureSize, nVertices, nFrames);
+    
+    vector<float> texels((size_t)textureWidth * textureHeight * 3, 0.0f);
+    AxisAlignedBox animationBox;
+    
+    for (int frame = 0; frame < nFrames; frame++)
+    {
+        mesh.applyAnimation(startTime + frame / frameRate);
+        mesh.updateJointMatrices();
+        mesh.applySkinning();
+        
+        float* frameTexels = &texels[(size_t)frame * nVertices * 3];
+        
+        const PositionArrays& positions = mesh.skinnedPositions;
+        
+        for (int i = 0; i < nVertices; i++)
+        {
+            frameTexels[i * 3 + 0] = positions.x[i];
+            frameTexels[i * 3 + 1] = positions.y[i];
+            frameTexels[i * 3 + 2] = positions.z[i];
+            
+            animationBox.add(vec3(positions.x[i], positions.y[i], positions.z[i]));
+        }
+    }
+    
+    boundingSphere = BoundingSphere(animationBox.getCenter(), glm::length(animationBox.getHalfExtent()));
+    
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    
+    // frames are interpolated in the shader, texels must never be filtered
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, textureWidth, textureHeight, 0, GL_RGB, GL_FLOAT, texels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+    
+    vector<float> vertexIndices(nVertices);
+    for (int i = 0; i < nVertices; i++)
+        vertexIndices[i] = (float)i;
+    
+    vector<GLuint> indices;
+    lodRanges = LodIndexRanges();
+    
+    for (int level = 0; level < mesh.getLodCount(); level++)
+        lodRanges.addLevel(indices, mesh.getLodIndices(level));
+    
+    glGenBuffers(1, &vertexIndexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexIndexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexIndices.size() * sizeof(float), vertexIndices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    glGenBuffers(1, &elementBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    
+    printf("Baked vertex animation texture: %d vertices, %d frames, %d x %d texels (%.1f Mb)\n",
+           nVertices, nFrames, textureWidth, textureHeight, (ftype)(texels.size() * sizeof(float)) / 1e6);
+}
+
+void VertexAnimationTexture::destroy()
+{
+    if (textureId)
+    {
+        glDeleteTextures(1, &textureId);
+        textureId = 0;
+    }
+    
+    for (GLuint* buffer: { &vertexIndexBuffer, &elementBuffer })
+        if (*buffer)
+        {
+            glDeleteBuffers(1, buffer);
+            *buffer = 0;
+        }
+    
+    instanceLods.clear();
+}
+
+void VertexAnimationTexture::renderInstances(GLuint program, mat4 projectionViewMatrix, mat4 modelMatrix,
+                                             const vector<vec4>& instances, ftype time)
+{
+    if (instances.empty())
+        return;
+    
+    SDL_assert(textureId);
+    
+    int nLevels = lodRanges.getLevelCount();
+    instanceLods.resize(instances.size(), 0);
+    
+    // instances are grouped by level, every group is a range of the instance data
+    vector<vector<int>> levelInstances(nLevels);
+    BoundingSphere modelSphere = boundingSphere.transformed(modelMatrix);
+    
+    for (int i = 0; i < (int)instances.size(); i++)
+    {
+        int level = 0;
+        
+        if (useLods)
+        {
+            BoundingSphere worldSphere(modelSphere.center + vec3(instances[i]), modelSphere.radius);
+            level = lodSelector.select(instanceLods[i], getProjectedSize(projectionViewMatrix, worldSphere), nLevels);
+        }
+        
+        instanceLods[i] = level;
+        levelInstances[level].push_back(i);
+    }
+    
+    StreamingBuffer& stream = StreamingBuffer::instance();
+    StreamingAllocation instanceData = stream.allocate(instances.size() * 4 * sizeof(float));
+    
+    float* data = (float*)instanceData.data;
+    for (const vector<int>& group: levelInstances)
+        for (int instance: group)
+            for (int i = 0; i < 4; i++)
+                *data++ = (float)instances[instance][i];
+    
+    stream.flush();
+    
+    glUseProgram(program);
+    
+    glm::mat4 projectionView(projectionViewMatrix), model(modelMatrix);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projectionViewMatrix"), 1, GL_FALSE, glm::value_ptr(projectionView));
+    glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(model));
+    
+    glUniform2f(glGetUniformLocation(program, "textureSize"), (float)textureWidth, (float)textureHeight);
+    glUniform1f(glGetUniformLocation(program, "vertexCount"), (float)nVertices);
+    glUniform1f(glGetUniformLocation(program, "frameCount"), (float)nFrames);
+    glUniform1f(glGetUniformLocation(program, "frameRate"), (float)frameRate);
+    
+    // keep the time small, float precision is not enough for long sessions otherwise
+    glUniform1f(glGetUniformLocation(program, "time"), (float)fmod(time, nFrames / frameRate));
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+    glUniform1i(glGetUniformLocation(program, "animationTexture"), 0);
+    
+    GLint instanceLocation = glGetAttribLocation(program, "instanceData");
+    verify(instanceLocation > 0, "Vertex animation program must bind 'vertexIndex' to 0 and use 'instanceData'.");
+    
+    glBindBuffer(GL_ARRAY_BUFFER, vertexIndexBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+    
+    glBindBuffer(GL_ARRAY_BUFFER, instanceData.buffer);
+    glEnableVertexAttribArray(instanceLocation);
+    glVertexAttribDivisor(instanceLocation, 1);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+    
+    size_t firstInstance = 0;
+    
+    for (int level = 0; level < nLevels; level++)
+    {
+        size_t nInstances = levelInstances[level].size();
+        if (nInstances == 0)
+            continue;
+        
+        glVertexAttribPointer(instanceLocation, 4, GL_FLOAT, GL_FALSE, 0,
+                              (const GLvoid*)(instanceData.offset + firstInstance * 4 * sizeof(float)));
+        glDrawElementsInstanced(GL_TRIANGLES, lodRanges.getIndexCount(level), GL_UNSIGNED_INT,
+                                lodRanges.getIndexOffset(level), (GLsizei)nInstances);
+        
+        firstInstance += nInstances;
+    }
+    
+    glVertexAttribDivisor(instanceLocation, 0);
+    glDisableVertexAttribArray(instanceLocation);
+    glDisableVertexAttribArray(0);
+    
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
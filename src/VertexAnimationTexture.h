@@ -0,0 +1,52 @@
+#ifndef SGE_VERTEX_ANIMATION_TEXTURE_H
+#define SGE_VERTEX_ANIMATION_TEXTURE_H
+
+#include "Common.h"
+#include "ColladaMeshLoader.h"
+
+#include <vector>
+
+namespace sge
+{
+
+// Skinned positions of every vertex of a mesh, sampled over the whole animation
+// with a fixed frame rate and stored in a float texture.
+// Texel (frame * nVertices + vertex) holds the position, rows are wrapped at textureWidth.
+// Played back by vat-vertex-shader.glsl, instances only differ by an offset & a time shift,
+// so no CPU animation work is done at all and every instance is drawn with one call.
+class VertexAnimationTexture
+{
+public :
+    GLuint textureId = 0;
+    int textureWidth = 0, textureHeight = 0;
+    
+    int nVertices = 0;
+    int nFrames = 0;
+    ftype frameRate = 0;
+    
+    // per-vertex float index used to address the texture
+    GLuint vertexIndexBuffer = 0;
+    GLuint elementBuffer = 0;
+    LodIndexRanges lodRanges;
+    
+    // of the positions in every frame, in mesh space
+    BoundingSphere boundingSphere;
+    
+    // every instance has its own level, instances are matched to their previous levels by index
+    LodSelector lodSelector;
+    bool useLods = true;
+    std::vector<int> instanceLods;
+    
+    // runs the usual animation & skinning path over the mesh animation, mesh pose is changed
+    void bake(Mesh& mesh, ftype framesPerSecond);
+    void destroy();
+    
+    // instance: xyz is a world space offset, w is a time shift in seconds;
+    // one draw per level of detail in use
+    void renderInstances(GLuint program, mat4 projectionViewMatrix, mat4 modelMatrix,
+                         const std::vector<vec4>& instances, ftype time);
+};
+
+}
+
+#endif // SGE_VERTEX_ANIMATION_TEXTURE_H
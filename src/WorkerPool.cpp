@@ -0,0 +1,112 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace sge;
+
+WorkerPool::WorkerPool()
+{
+    int nWorkers = max(0, (int)thread::hardware_concurrency() - 1);
+    
+    for (int i = 0; i < nWorkers; i++)
+        workers.push_back(thread(&WorkerPool::workerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    
+    taskAdded.notify_all();
+    
+    for (thread& worker: workers)
+        worker.join();
+}
+
+WorkerPool& WorkerPool::instance()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+void WorkerPool::runTask(Task& task, unique_lock<mutex>& lock)
+{
+    lock.unlock();
+    task.function();
+    lock.lock();
+    
+    task.group->nPending--;
+    taskFinished.notify_all();
+}
+
+void WorkerPool::workerLoop()
+{
+    unique_lock<mutex> lock(queueMutex);
+    
+    while (true)
+    {
+        taskAdded.wait(lock, [this] { return stopping || !queue.empty(); });
+        
+        if (queue.empty())
+            return;
+        
+        Task task = move(queue.front());
+        queue.pop_front();
+        runTask(task, lock);
+    }
+}
+
+void WorkerPool::submit(TaskGroup& group, function<void()> function)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        group.nPending++;
+        queue.push_back(Task { &group, move(function) });
+    }
+    
+    taskAdded.notify_one();
+}
+
+void WorkerPool::submitRanges(TaskGroup& group, int begin, int end, int rangeSize, function<void(int, int)> function)
+{
+    SDL_assert(rangeSize > 0);
+    
+    for (int rangeBegin = begin; rangeBegin < end; rangeBegin += rangeSize)
+    {
+        int rangeEnd = min(end, rangeBegin + rangeSize);
+        submit(group, [function, rangeBegin, rangeEnd] { function(rangeBegin, rangeEnd); });
+    }
+}
+
+bool TaskGroup::isIdle() const
+{
+    WorkerPool& pool = WorkerPool::instance();
+    lock_guard<mutex> lock(pool.queueMutex);
+    return nPending == 0;
+}
+
+void TaskGroup::wait()
+{
+    WorkerPool& pool = WorkerPool::instance();
+    unique_lock<mutex> lock(pool.queueMutex);
+    
+    while (nPending > 0)
+    {
+        // help with own tasks first, then wait for the ones already taken by workers
+        auto own = find_if(pool.queue.begin(), pool.queue.end(),
+                           [this] (const WorkerPool::Task& task) { return task.group == this; });
+        
+        if (own == pool.queue.end())
+        {
+            pool.taskFinished.wait(lock);
+            continue;
+        }
+        
+        WorkerPool::Task task = move(*own);
+        pool.queue.erase(own);
+        pool.runTask(task, lock);
+    }
+}
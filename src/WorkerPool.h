@@ -0,0 +1,75 @@
+#ifndef SGE_WORKER_POOL_H
+#define SGE_WORKER_POOL_H
+
+#include "Common.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace sge
+{
+
+class WorkerPool;
+
+// Tasks submitted together; wait() runs queued tasks on the calling thread until all of them are done.
+// Copies are empty groups, so objects owning one stay copyable while idle.
+class TaskGroup
+{
+    friend class WorkerPool;
+    
+    std::atomic<int> nPending { 0 };
+
+public :
+    TaskGroup() {}
+    TaskGroup(const TaskGroup&) {}
+    TaskGroup& operator=(const TaskGroup&) { SDL_assert(nPending == 0); return *this; }
+    ~TaskGroup() { if (nPending) wait(); }
+    
+    bool isIdle() const;
+    void wait();
+};
+
+// hardware_concurrency - 1 worker threads, the thread calling TaskGroup::wait is the last one
+class WorkerPool
+{
+    struct Task
+    {
+        TaskGroup* group;
+        std::function<void()> function;
+    };
+    
+    std::vector<std::thread> workers;
+    std::deque<Task> queue;
+    
+    // single lock for the queue & every group counter
+    std::mutex queueMutex;
+    std::condition_variable taskAdded, taskFinished;
+    bool stopping = false;
+    
+    WorkerPool();
+    ~WorkerPool();
+    
+    void workerLoop();
+    void runTask(Task& task, std::unique_lock<std::mutex>& lock);
+    
+    friend class TaskGroup;
+
+public :
+    static WorkerPool& instance();
+    
+    int getThreadCount() const { return (int)workers.size() + 1; }
+    
+    void submit(TaskGroup& group, std::function<void()> function);
+    
+    // splits [begin, end) into ranges of at most rangeSize, returns without waiting
+    void submitRanges(TaskGroup& group, int begin, int end, int rangeSize, std::function<void(int, int)> function);
+};
+
+}
+
+#endif // SGE_WORKER_POOL_H